@@ -0,0 +1,95 @@
+// Store the language model state of every target phrase in a binary phrase
+// table, so decode copies it instead of scoring target phrases with the
+// language model as it loads them.  decode checks that it has the same
+// language model and scores them itself if not.
+#include "decode/lm.hh"
+#include "pt/access.hh"
+#include "pt/format.hh"
+#include "pt/lm_state.hh"
+#include "pt/query.hh"
+#include "pt/statistics.hh"
+#include "util/file.hh"
+#include "util/usage.hh"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Language model state of rows with target words in the table's vocabulary.
+class StateMaker {
+  public:
+    StateMaker(const decode::LM &lm, pt::VocabRange vocab) : lm_(lm) {
+      const lm::ngram::Vocabulary &lm_vocab = lm.Model().GetVocabulary();
+      auto word = vocab.begin();
+      // <unk> is 0 in both.
+      to_lm_.push_back(0);
+      for (++word; word != vocab.end(); ++word) {
+        to_lm_.push_back(lm_vocab.Index(*word));
+      }
+    }
+
+    void operator()(const pt::Access &access, const pt::Row *row, std::vector<uint8_t> &state) {
+      words_.clear();
+      for (pt::WordIndex word : access.target(row)) {
+        UTIL_THROW_IF2(word >= to_lm_.size(), "Target word " << word << " is not in the table's vocabulary.");
+        words_.push_back(to_lm_[word]);
+      }
+      lm::ngram::ChartState chart_state;
+      float score = lm_.ScorePhrase(words_.data(), words_.data() + words_.size(), chart_state);
+      decode::LM::SaveState(score, chart_state, state);
+    }
+
+  private:
+    const decode::LM &lm_;
+    // Indexed by table word.
+    std::vector<lm::WordIndex> to_lm_;
+    std::vector<lm::WordIndex> words_;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    namespace po = boost::program_options;
+    po::options_description options("Language model state options");
+    std::string lm_file, phrase_file, out_file;
+    options.add_options()
+      ("lm,l", po::value<std::string>(&lm_file)->required(), "Language model file that decode will use")
+      ("phrase,p", po::value<std::string>(&phrase_file)->required(), "Binary phrase table, not compact")
+      ("output,o", po::value<std::string>(&out_file)->required(), "Write the table with state here.  Further shards are named like the input's");
+    if (argc == 1) {
+      std::cerr << options << std::endl;
+      return 1;
+    }
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+
+    decode::LM lm(lm_file.c_str());
+    uint64_t shards;
+    std::unique_ptr<StateMaker> maker;
+    {
+      pt::Table table(phrase_file.c_str(), util::LAZY);
+      shards = table.Stats().shards;
+      maker.reset(new StateMaker(lm, table.Vocab()));
+    }
+    const uint64_t checksum = lm.Checksum();
+    for (uint64_t i = 0; i < shards; ++i) {
+      pt::AddLMStates(
+          util::OpenReadOrThrow(pt::ShardFile(phrase_file, i).c_str()),
+          util::CreateOrThrow(pt::ShardFile(out_file, i).c_str()),
+          checksum,
+          boost::ref(*maker));
+    }
+    util::PrintUsage(std::cerr);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,143 @@
+#include "decode/baked_vocab.hh"
+
+#include "decode/system.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+#include "util/murmur_hash.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace decode {
+
+namespace {
+
+const char kMagic[] = "mtplz baked vocab 1\n";
+
+struct Header {
+  char magic[sizeof(kMagic)];
+  uint64_t table_fingerprint;
+  uint64_t lm_checksum;
+  // Including <unk>.
+  uint64_t vocab_size;
+  uint64_t word_bytes;
+  uint64_t map_bytes;
+  uint64_t string_bytes;
+};
+
+const float kMultiply = 1.5;
+
+uint64_t Pad(uint64_t size) {
+  return (size + 7) & ~static_cast<uint64_t>(7);
+}
+
+void WritePad(int fd, uint64_t size) {
+  const char zeros[8] = {0};
+  util::WriteOrThrow(fd, zeros, Pad(size) - size);
+}
+
+} // namespace
+
+BakedVocab::BakedVocab(const std::string &file, util::LoadMethod load_method) {
+  util::scoped_fd fd(util::OpenReadOrThrow(file.c_str()));
+  const uint64_t file_size = util::SizeOrThrow(fd.get());
+  UTIL_THROW_IF2(file_size < sizeof(Header), "Baked vocabulary " << file << " is too short");
+  util::MapRead(load_method, fd.get(), 0, util::CheckOverflow(file_size), mem_);
+  const Header &header = *reinterpret_cast<const Header*>(mem_.get());
+  UTIL_THROW_IF2(std::memcmp(header.magic, kMagic, sizeof(kMagic)), file << " is not a baked vocabulary");
+  size_ = header.vocab_size;
+  word_bytes_ = header.word_bytes;
+  char *base = static_cast<char*>(mem_.get()) + sizeof(Header);
+  words_ = base;
+  base += Pad(size_ * word_bytes_);
+  map_ = Map(base, header.map_bytes);
+  base += Pad(header.map_bytes);
+  offsets_ = reinterpret_cast<const uint64_t*>(base);
+  base += (size_ + 1) * sizeof(uint64_t);
+  strings_ = base;
+  UTIL_THROW_IF2(static_cast<uint64_t>(base - static_cast<char*>(mem_.get())) + header.string_bytes > file_size, "Baked vocabulary " << file << " is truncated");
+}
+
+uint64_t BakedVocab::TableFingerprint() const {
+  return reinterpret_cast<const Header*>(mem_.get())->table_fingerprint;
+}
+
+uint64_t BakedVocab::LMChecksum() const {
+  return reinterpret_cast<const Header*>(mem_.get())->lm_checksum;
+}
+
+std::size_t BakedVocab::WordBytes() const { return word_bytes_; }
+
+void BakedVocab::Write(const BaseVocab &base, std::size_t word_bytes, uint64_t table_fingerprint, uint64_t lm_checksum, const std::string &file) {
+  const std::size_t size = base.Size();
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.table_fingerprint = table_fingerprint;
+  header.lm_checksum = lm_checksum;
+  header.vocab_size = size;
+  header.word_bytes = word_bytes;
+
+  header.map_bytes = Map::Size(size, kMultiply);
+  util::scoped_memory map_mem;
+  util::HugeMalloc(header.map_bytes, true, map_mem);
+  Map map(map_mem.get(), header.map_bytes);
+  std::vector<uint64_t> offsets(1, 0);
+  offsets.reserve(size + 1);
+  // <unk> is not in the table, so Find returns 0 for it like any other
+  // unknown word.
+  for (ID id = 0; id < size; ++id) {
+    StringPiece str(base.String(id));
+    if (id) {
+      util::MutableVocabInternal entry;
+      entry.key = util::MurmurHashNative(str.data(), str.size());
+      entry.id = id;
+      map.Insert(entry);
+    }
+    offsets.push_back(offsets.back() + str.size());
+  }
+  header.string_bytes = offsets.back();
+
+  // util::MakeTemp unlinks its file, so name one here to rename later.
+  std::string temp(file + ".XXXXXX");
+  util::scoped_fd fd(mkstemp(&temp[0]));
+  UTIL_THROW_IF(fd.get() == -1, util::ErrnoException, "Failed to make a temporary file for " << file);
+  try {
+    // mkstemp makes the file private, but decoders run by other users may
+    // share it.
+    UTIL_THROW_IF(fchmod(fd.get(), 0644), util::ErrnoException, "Failed to set permissions on " << temp);
+    // Sections are gathered and written directly because util::FileStream
+    // flushes in its destructor, which would throw again while unwinding
+    // from a failed write.
+    std::string buffer;
+    buffer.reserve(size * word_bytes);
+    for (ID id = 0; id < size; ++id) {
+      buffer.append(reinterpret_cast<const char*>(base.Word(id)), word_bytes);
+    }
+    util::WriteOrThrow(fd.get(), &header, sizeof(Header));
+    util::WriteOrThrow(fd.get(), buffer.data(), buffer.size());
+    WritePad(fd.get(), buffer.size());
+    util::WriteOrThrow(fd.get(), map_mem.get(), header.map_bytes);
+    WritePad(fd.get(), header.map_bytes);
+    util::WriteOrThrow(fd.get(), offsets.data(), offsets.size() * sizeof(uint64_t));
+    buffer.clear();
+    buffer.reserve(header.string_bytes);
+    for (ID id = 0; id < size; ++id) {
+      StringPiece str(base.String(id));
+      buffer.append(str.data(), str.size());
+    }
+    util::WriteOrThrow(fd.get(), buffer.data(), buffer.size());
+    UTIL_THROW_IF(std::rename(temp.c_str(), file.c_str()), util::ErrnoException, "Failed to rename " << temp << " to " << file);
+  } catch (...) {
+    unlink(temp.c_str());
+    throw;
+  }
+}
+
+} // namespace decode
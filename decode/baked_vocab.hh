@@ -0,0 +1,86 @@
+#pragma once
+
+#include "decode/id.hh"
+#include "util/mmap.hh"
+#include "util/mutable_vocab.hh"
+#include "util/probing_hash_table.hh"
+#include "util/string_piece.hh"
+
+#include <cstddef>
+#include <string>
+
+#include <stdint.h>
+
+/* The phrase table vocabulary and the VocabWord of every word, as
+ * System::LoadVocab makes them, saved to a file that is mapped instead of
+ * rebuilt.  Building walks the whole vocabulary, hashing each string and
+ * calling every feature's NewWord (the language model looks each word up),
+ * while mapping costs a page fault for each page that is used.
+ *
+ * A VocabWord depends on the features and language model, so the file
+ * records the table's fingerprint, the language model's checksum, and the
+ * word layout's size, and System::LoadVocab spot-checks words against the
+ * current features before using it.  The file is
+ *   Header
+ *   VocabWords, each Header::word_bytes, indexed by pt id
+ *   hash table from util::MurmurHashNative of the string to pt id
+ *   Header::vocab_size + 1 offsets into the strings
+ *   strings, back to back
+ * with each section padded to 8 bytes.
+ */
+namespace decode {
+
+struct BaseVocab;
+struct VocabWord;
+
+class BakedVocab {
+  public:
+    // Map file, which must have been written by Write.  Throws
+    // util::ErrnoException if the file cannot be read and util::Exception if
+    // it is not a baked vocabulary.
+    BakedVocab(const std::string &file, util::LoadMethod load_method);
+
+    // Save base, filled by System::LoadVocab with word_bytes per VocabWord,
+    // for the table with table_fingerprint and the language model with
+    // lm_checksum.  Writes a uniquely named temporary file in the same
+    // directory then renames it, so concurrent readers see the old file or
+    // the new one and concurrent writers do not share a temporary file.
+    static void Write(const BaseVocab &base, std::size_t word_bytes, uint64_t table_fingerprint, uint64_t lm_checksum, const std::string &file);
+
+    // What the file was made for.
+    uint64_t TableFingerprint() const;
+    uint64_t LMChecksum() const;
+    std::size_t WordBytes() const;
+
+    // Includes <unk>.
+    std::size_t Size() const { return size_; }
+
+    // 0 (<unk>) if absent.
+    ID Find(const StringPiece &str) const {
+      Map::ConstIterator i;
+      return map_.Find(util::MurmurHashNative(str.data(), str.size()), i) ? i->id : 0;
+    }
+
+    StringPiece String(ID id) const {
+      return StringPiece(strings_ + offsets_[id], offsets_[id + 1] - offsets_[id]);
+    }
+
+    // The mapping is read-only.  Features only write VocabWords in NewWord,
+    // which is not called for baked words.
+    VocabWord *Word(ID id) const {
+      return reinterpret_cast<VocabWord*>(words_ + id * word_bytes_);
+    }
+
+  private:
+    typedef util::ProbingHashTable<util::MutableVocabInternal, util::IdentityHash, std::equal_to<uint64_t>, util::Power2Mod> Map;
+
+    util::scoped_memory mem_;
+
+    std::size_t size_, word_bytes_;
+    char *words_;
+    Map map_;
+    const uint64_t *offsets_;
+    const char *strings_;
+};
+
+} // namespace decode
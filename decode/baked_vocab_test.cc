@@ -0,0 +1,56 @@
+#include "decode/baked_vocab.hh"
+
+#include "decode/system.hh"
+#include "util/file.hh"
+#include "util/layout.hh"
+
+#include <string>
+
+#include <unistd.h>
+
+#define BOOST_TEST_MODULE BakedVocabTest
+#include <boost/test/unit_test.hpp>
+
+namespace decode {
+namespace {
+
+BOOST_AUTO_TEST_CASE(RoundTrip) {
+  util::Layout layout;
+  util::PODField<ID> pt_id(layout);
+  util::PODField<uint32_t> other(layout);
+  BaseVocab base;
+  base.map.push_back(reinterpret_cast<VocabWord*>(layout.Allocate(base.pool)));
+  pt_id(base.map[0]) = 0;
+  other(base.map[0]) = 7;
+  for (const char *word : {"small", "test", "a"}) {
+    ID id = base.vocab.FindOrInsert(word);
+    BOOST_REQUIRE_EQUAL(base.map.size(), id);
+    base.map.push_back(reinterpret_cast<VocabWord*>(layout.Allocate(base.pool)));
+    pt_id(base.map[id]) = id;
+    other(base.map[id]) = 10 * id;
+  }
+
+  const std::string file(util::DefaultTempDirectory() + "baked_vocab_test." + std::to_string(getpid()));
+  BakedVocab::Write(base, layout.OffsetsEnd(), 42, 43, file);
+  BakedVocab baked(file, util::READ);
+  unlink(file.c_str());
+
+  BOOST_CHECK_EQUAL(42, baked.TableFingerprint());
+  BOOST_CHECK_EQUAL(43, baked.LMChecksum());
+  BOOST_CHECK_EQUAL(layout.OffsetsEnd(), baked.WordBytes());
+  BOOST_REQUIRE_EQUAL(4, baked.Size());
+  BOOST_CHECK_EQUAL(1, baked.Find("small"));
+  BOOST_CHECK_EQUAL(2, baked.Find("test"));
+  BOOST_CHECK_EQUAL(3, baked.Find("a"));
+  BOOST_CHECK_EQUAL(0, baked.Find("absent"));
+  BOOST_CHECK_EQUAL("test", baked.String(2));
+  BOOST_CHECK_EQUAL("a", baked.String(3));
+  BOOST_CHECK_EQUAL(7, other(baked.Word(0)));
+  for (ID id = 1; id < 4; ++id) {
+    BOOST_CHECK_EQUAL(id, pt_id(baked.Word(id)));
+    BOOST_CHECK_EQUAL(10 * id, other(baked.Word(id)));
+  }
+}
+
+} // namespace
+} // namespace decode
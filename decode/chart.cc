@@ -1,24 +1,62 @@
 #include "decode/chart.hh"
 
+#include "decode/coverage.hh"
 #include "decode/system.hh"
 #include "pt/access.hh"
 #include "util/exception.hh"
 #include "util/file_piece.hh"
 #include "util/tokenize_piece.hh"
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+
 namespace decode {
 
 Chart::Chart(std::size_t max_source_phrase_length,
     const BaseVocab &vocab,
     Objective &objective,
-    VertexCache &cache)
-    : max_source_phrase_length_(max_source_phrase_length),
+    VertexCache &cache,
+    std::size_t table_limit,
+    std::size_t lazy_lm)
+    : vocab_map_(objective, vocab),
       objective_(objective),
       feature_init_(objective.GetFeatureInit()),
-      cache_(cache),
-      vocab_map_(objective, vocab) {
+      max_source_phrase_length_(max_source_phrase_length),
+      table_limit_(table_limit ? table_limit : std::numeric_limits<std::size_t>::max()),
+      lazy_lm_(lazy_lm),
+      cache_(cache) {
   UTIL_THROW_IF(objective.GetLanguageModelFeature() == nullptr, util::Exception,
       "Missing language model for objective!");
+  UTIL_THROW_IF2(max_source_phrase_length > Coverage::kBits, "Source phrases of length " << max_source_phrase_length
+      << " exceed the coverage window of " << Coverage::kBits << " words.  Rebuild with a larger DECODE_COVERAGE_BITS.");
+  InitEndOfSentence();
+}
+
+Chart::~Chart() {
+  for (VertexCache::Entry *entry : pinned_) {
+    cache_.Release(entry);
+  }
+}
+
+void Chart::Clear() {
+  for (VertexCache::Entry *entry : pinned_) {
+    cache_.Release(entry);
+  }
+  pinned_.clear();
+  vocab_map_.Clear();
+  vertices_used_ = 0;
+  target_phrase_pool_.Reset();
+  passthrough_pool_.Reset();
+  sentence_.clear();
+  sentence_ids_.clear();
+  entries_.clear();
+  stats_ = Stats();
+  // The end of sentence phrase lived in passthrough_pool_.
+  InitEndOfSentence();
+}
+
+void Chart::InitEndOfSentence() {
   pt::Access access = feature_init_.phrase_access;
   eos_phrase_ = access.Allocate(passthrough_pool_);
   if (feature_init_.phrase_access.target) {
@@ -36,29 +74,79 @@ void Chart::ReadSentence(StringPiece input) {
   }
 }
 
-void Chart::AddTargetPhraseToVertex(
-    const pt::Row *phrase,
-    search::Vertex &vertex,
-    TargetPhraseType type,
-    bool use_cache) {
-  util::Pool &phrase_pool = use_cache ? cache_.target_phrase_pool : target_phrase_pool_;
+std::size_t Chart::TargetPhraseMemory(std::size_t count) const {
+  return count * feature_init_.target_phrase_layout.OffsetsEnd();
+}
+
+search::Vertex &Chart::NewVertex() {
+  if (vertices_used_ == vertices_.size()) {
+    vertices_.emplace_back();
+  }
+  search::Vertex &ret = vertices_[vertices_used_++];
+  ret.Root().InitRoot();
+  return ret;
+}
+
+TargetPhrase *Chart::NewTargetPhrase(const pt::Row *phrase, util::Pool &phrase_pool) {
   TargetPhrase *phrase_wrapper = reinterpret_cast<TargetPhrase*>(
       feature_init_.target_phrase_layout.Allocate(phrase_pool));
   feature_init_.pt_row_field(phrase_wrapper) = phrase;
+  return phrase_wrapper;
+}
+
+float Chart::AddToVertex(
+    TargetPhrase *phrase_wrapper,
+    search::Vertex &vertex,
+    TargetPhraseType type,
+    util::Pool &phrase_pool) {
   search::HypoState hypo;
   TargetPhraseInfo target{phrase_wrapper, vocab_map_, phrase_pool, type};
   // Bypass objective to allow the language model access to a hypo.state reference.
   objective_.GetLanguageModelFeature()->InitTargetPhrase(target, hypo.state);
+  DECODE_STATS_ADD(stats_.target_phrases, 1);
   float score = objective_.ScoreTargetPhrase(target);
   feature_init_.phrase_score_field(phrase_wrapper) = score;
   hypo.score = score;
   hypo.history.cvp = phrase_wrapper;
   vertex.Root().AppendHypothesis(hypo);
+  return score;
+}
+
+void Chart::AddBounded(const pt::Row *phrase, util::Pool &phrase_pool) {
+  Bounded add;
+  add.phrase = NewTargetPhrase(phrase, phrase_pool);
+  TargetPhraseInfo target{add.phrase, vocab_map_, phrase_pool, TargetPhraseType::Table};
+  add.bound = objective_.ScoreTargetPhraseWithoutLM(target);
+  bounded_.push_back(add);
+}
+
+void Chart::AddBest(search::Vertex &vertex, util::Pool &phrase_pool) {
+  std::stable_sort(bounded_.begin(), bounded_.end(), [](const Bounded &first, const Bounded &second) {
+    return first.bound > second.bound;
+  });
+  best_.clear();
+  // A negative language model weight makes the bounds wrong, in which case
+  // everything is scored.
+  bool bounds_hold = true;
+  std::vector<Bounded>::const_iterator i = bounded_.begin();
+  for (; i != bounded_.end(); ++i) {
+    if (bounds_hold && best_.size() == lazy_lm_ && best_.front() >= i->bound) break;
+    float score = AddToVertex(i->phrase, vertex, TargetPhraseType::Table, phrase_pool);
+    bounds_hold &= (score <= i->bound);
+    if (best_.size() < lazy_lm_) {
+      best_.push_back(score);
+      std::push_heap(best_.begin(), best_.end(), std::greater<float>());
+    } else if (score > best_.front()) {
+      std::pop_heap(best_.begin(), best_.end(), std::greater<float>());
+      best_.back() = score;
+      std::push_heap(best_.begin(), best_.end(), std::greater<float>());
+    }
+  }
+  DECODE_STATS_ADD(stats_.lazy_skipped, bounded_.end() - i);
 }
 
 void Chart::AddPassthrough(std::size_t position) {
-  TargetPhrases *pass = vertex_pool_.construct();
-  pass->Root().InitRoot();
+  TargetPhrases *pass = &NewVertex();
   pt::Access access = feature_init_.phrase_access;
   pt::Row* pt_phrase = access.Allocate(passthrough_pool_);
   if (access.target) {
@@ -66,15 +154,14 @@ void Chart::AddPassthrough(std::size_t position) {
     access.target(pt_phrase)[0] = sentence_ids_[position];
   }
   objective_.InitPassthroughPhrase(pt_phrase, TargetPhraseType::Passthrough);
-  AddTargetPhraseToVertex(pt_phrase, *pass, TargetPhraseType::Passthrough, false);
+  AddTargetPhraseToVertex(pt_phrase, *pass, TargetPhraseType::Passthrough, target_phrase_pool_);
   pass->Root().FinishRoot(search::kPolicyLeft);
   SetRange(position, position+1, pass);
 }
 
 TargetPhrases &Chart::EndOfSentence() {
-  search::Vertex &eos = *vertex_pool_.construct();
-  eos.Root().InitRoot();
-  AddTargetPhraseToVertex(eos_phrase_, eos, TargetPhraseType::EOS, false);
+  search::Vertex &eos = NewVertex();
+  AddTargetPhraseToVertex(eos_phrase_, eos, TargetPhraseType::EOS, target_phrase_pool_);
   eos.Root().FinishRoot(search::kPolicyLeft);
   return eos;
 }
@@ -2,17 +2,20 @@
 #define DECODE_CHART__
 
 #include "decode/source_phrase.hh"
+#include "decode/stats.hh"
 #include "decode/vocab_map.hh"
 #include "decode/types.hh"
+#include "decode/vertex_cache.hh"
 #include "pt/format.hh"
+#include "pt/hash.hh"
+#include "pt/query.hh"
 #include "search/vertex.hh"
 #include "util/pool.hh"
 #include "util/string_piece.hh"
 
-#include <boost/pool/object_pool.hpp>
-#include <boost/unordered_map.hpp>
 #include <boost/utility.hpp>
 
+#include <deque>
 #include <vector>
 
 namespace util { class MutableVocab; }
@@ -21,52 +24,97 @@ namespace decode {
 
 class Objective;
 struct BaseVocab;
+struct TargetPhrase;
 struct FeatureInit;
 
 typedef search::Vertex TargetPhrases;
 
-// TODO currently not thread-safe because of cache_!
-// Target phrases that correspond to each source span
+// Target phrases that correspond to each source span.  A Chart can be reused
+// for many sentences by calling Clear in between, which keeps its memory.
 class Chart {
   public:
-    typedef boost::unordered_map<SourcePhrase,search::Vertex,SourcePhraseHasher,SourcePhraseEqual> VertexMap;
-    struct VertexCache {
-      VertexCache() {}
-      explicit VertexCache(std::size_t size) : map(size) {}
-      VertexMap map;
-      util::Pool target_phrase_pool;
-    };
-
     static constexpr ID EOS_WORD = 2;
 
-    Chart(std::size_t max_source_phrase_length, const BaseVocab &vocab, Objective &objective, VertexCache &cache);
+    // cache may be shared with Charts in other threads.
+    // table_limit bounds the target phrases loaded per source phrase, 0 for
+    // no limit.  lazy_lm is Config::lazy_lm.
+    Chart(std::size_t max_source_phrase_length, const BaseVocab &vocab, Objective &objective, VertexCache &cache, std::size_t table_limit = 0, std::size_t lazy_lm = 0);
+
+    ~Chart();
 
+    // The chart must be new or cleared.
     void ReadSentence(StringPiece input);
 
+    // Forget the sentence and release its cache entries.  Pools and vectors
+    // keep their capacity for the next sentence.
+    void Clear();
+
     template <class PhraseTable> void LoadPhrases(const PhraseTable &table) {
       // There's some unreachable ranges off the edge. Meh.
       entries_.resize(sentence_.size() * max_source_phrase_length_);
+      found_.assign(entries_.size(), Found());
+      // Find spans shortest first.  A span is only looked up if some source
+      // phrase extends the span one word shorter.  Each length checks the
+      // cache and then looks up what the cache lacks in one batch so the
+      // phrase table's cache misses overlap.
+      for (std::size_t length = 1; length <= max_source_phrase_length_; ++length) {
+        spans_.clear();
+        slots_.clear();
+        for (std::size_t begin = 0; begin + length <= sentence_.size(); ++begin) {
+          if (length > 1 && !found_[Slot(begin, begin + length - 1)].longer) {
+            DECODE_STATS_ADD(stats_.spans_pruned, 1);
+            continue;
+          }
+          Found &found = found_[Slot(begin, begin + length)];
+          found.visited = true;
+          // The span one word shorter was visited, so extend its hash.
+          found.hash = pt::HashExtend(length == 1 ? pt::kSourceHashSeed : found_[Slot(begin, begin + length - 1)].hash, sentence_ids_[begin + length - 1]);
+          if (length <= cache_.MaxPhraseLength()) {
+            found.cached = cache_.Find(found.hash);
+            DECODE_STATS_ADD(stats_.cache_lookups, 1);
+            DECODE_STATS_ADD(stats_.cache_hits, found.cached != NULL);
+            if (found.cached) {
+              pinned_.push_back(found.cached);
+              found.longer = found.cached->Longer();
+              continue;
+            }
+          }
+          spans_.push_back(pt::SourceSpan(&sentence_ids_[begin], &sentence_ids_[begin] + length, found.hash));
+          slots_.push_back(Slot(begin, begin + length));
+        }
+        lookups_.resize(spans_.size());
+        table.Lookup(spans_.data(), spans_.size(), lookups_.data());
+        for (std::size_t i = 0; i < slots_.size(); ++i) {
+          found_[slots_[i]].rows = lookups_[i].rows;
+          found_[slots_[i]].longer = lookups_[i].longer;
+        }
+      }
+
       for (std::size_t begin = 0; begin != sentence_.size(); ++begin) {
         for (std::size_t end = begin + 1; (end != sentence_.size() + 1) && (end <= begin + max_source_phrase_length_); ++end) {
-          SourcePhrase source_phrase(sentence_, begin, end);
+          const Found &found = found_[Slot(begin, end)];
+          if (!found.visited) continue;
           search::Vertex *vertex;
-          bool use_cache = end - begin <= cached_phrase_max_length_;
-          if (use_cache) {
-            vertex = &cache_.map[source_phrase];
-            if (!vertex->Empty()) {
-              SetRange(begin, end, vertex);
-              continue;
+          if (found.cached) {
+            vertex = &found.cached->Vertex();
+          } else if (end - begin <= cache_.MaxPhraseLength()) {
+            // The same phrase may have been cached earlier in this sentence.
+            VertexCache::Entry *entry = cache_.Find(found.hash);
+            DECODE_STATS_ADD(stats_.cache_lookups, 1);
+            DECODE_STATS_ADD(stats_.cache_hits, entry != NULL);
+            if (!entry) {
+              entry = new VertexCache::Entry();
+              std::size_t count = LoadVertex(found.rows, entry->Vertex(), entry->PhrasePool());
+              entry->SetLonger(found.longer);
+              entry = cache_.Insert(found.hash, entry, TargetPhraseMemory(count));
             }
+            pinned_.push_back(entry);
+            vertex = &entry->Vertex();
           } else {
-            vertex = vertex_pool_.construct();
+            vertex = &NewVertex();
+            LoadVertex(found.rows, *vertex, target_phrase_pool_);
           }
-          auto phrases = table.Lookup(&sentence_ids_[begin], &*sentence_ids_.begin() + end);
-          if (phrases) {
-            vertex->Root().InitRoot();
-            for (auto phrase = phrases.begin(); phrase != phrases.end(); ++phrase) {
-              AddTargetPhraseToVertex(&*phrase, *vertex, TargetPhraseType::Table, use_cache);
-            }
-            vertex->Root().FinishRoot(search::kPolicyLeft);
+          if (!vertex->Empty()) {
             SetRange(begin, end, vertex);
           }
         }
@@ -94,24 +142,85 @@ class Chart {
 
     const VocabMap &VocabMapping() const { return vocab_map_; }
 
+    const Stats &GetStats() const { return stats_; }
+
   private:
-    void SetRange(std::size_t begin, std::size_t end, TargetPhrases *to) {
+    // Index of [begin, end) in entries_ and found_.
+    std::size_t Slot(std::size_t begin, std::size_t end) const {
       assert(end - begin <= max_source_phrase_length_);
-      assert(begin * max_source_phrase_length_ + end - begin - 1 < entries_.size());
-      entries_[begin * max_source_phrase_length_ + end - begin - 1] = to;
+      return begin * max_source_phrase_length_ + end - begin - 1;
     }
 
+    void SetRange(std::size_t begin, std::size_t end, TargetPhrases *to) {
+      assert(Slot(begin, end) < entries_.size());
+      entries_[Slot(begin, end)] = to;
+    }
+
+    // Score the target phrases of a lookup into vertex.  Returns how many
+    // there were.
+    template <class Rows> std::size_t LoadVertex(const Rows &phrases, search::Vertex &vertex, util::Pool &phrase_pool) {
+      DECODE_STATS_ADD(stats_.table_lookups, 1);
+      if (!phrases) return 0;
+      DECODE_STATS_ADD(stats_.table_hits, 1);
+      std::size_t count = 0;
+      vertex.Root().InitRoot();
+      if (lazy_lm_) {
+        bounded_.clear();
+        for (auto phrase = phrases.begin(); phrase != phrases.end() && count != table_limit_; ++phrase, ++count) {
+          AddBounded(phrase.Decode(phrase_pool), phrase_pool);
+        }
+        AddBest(vertex, phrase_pool);
+      } else {
+        for (auto phrase = phrases.begin(); phrase != phrases.end() && count != table_limit_; ++phrase, ++count) {
+          AddTargetPhraseToVertex(phrase.Decode(phrase_pool), vertex, TargetPhraseType::Table, phrase_pool);
+        }
+      }
+      vertex.Root().FinishRoot(search::kPolicyLeft);
+      return count;
+    }
+
+    std::size_t TargetPhraseMemory(std::size_t count) const;
+
+    // An empty vertex that lasts until Clear.
+    search::Vertex &NewVertex();
+
+    void InitEndOfSentence();
+
+    TargetPhrase *NewTargetPhrase(const pt::Row *phrase, util::Pool &phrase_pool);
+
+    // Score phrase, including the language model, and add it to vertex.
+    // Returns the score.
+    float AddToVertex(
+        TargetPhrase *phrase,
+        search::Vertex &vertex,
+        TargetPhraseType type,
+        util::Pool &phrase_pool);
+
     void AddTargetPhraseToVertex(
         const pt::Row *phrase,
         search::Vertex &vertex,
         TargetPhraseType type,
-        bool use_cache);
+        util::Pool &phrase_pool) {
+      AddToVertex(NewTargetPhrase(phrase, phrase_pool), vertex, type, phrase_pool);
+    }
+
+    // Append a table phrase to bounded_ without scoring it with the language
+    // model.
+    void AddBounded(const pt::Row *phrase, util::Pool &phrase_pool);
+
+    // Add the best lazy_lm_ of bounded_ to vertex, scoring them with the
+    // language model best bound first until no bound beats them.
+    void AddBest(search::Vertex &vertex, util::Pool &phrase_pool);
 
     void AddPassthrough(std::size_t position);
 
     VocabMap vocab_map_;
 
-    boost::object_pool<search::Vertex> vertex_pool_;
+    // Vertices for spans that are not cached.  Only the first vertices_used_
+    // belong to this sentence; the rest are kept for reuse.  A deque so
+    // growing does not move them.
+    std::deque<search::Vertex> vertices_;
+    std::size_t vertices_used_ = 0;
     util::Pool target_phrase_pool_;
 
     Objective &objective_;
@@ -120,6 +229,27 @@ class Chart {
     std::vector<VocabWord*> sentence_;
     std::vector<ID> sentence_ids_;
 
+    // What LoadPhrases found for a span.
+    struct Found {
+      // The span was checked in the cache or looked up rather than pruned.
+      bool visited = false;
+      // A longer source phrase starts with the span.
+      bool longer = false;
+      // pt::HashSource of the span, extended a word at a time.
+      uint64_t hash;
+      VertexCache::Entry *cached = NULL;
+      // Target phrases if not cached.
+      boost::iterator_range<pt::RowIterator> rows;
+    };
+
+    // Scratch for LoadPhrases, indexed by Slot.
+    std::vector<Found> found_;
+    // Spans of one length to look up, their slots, and what the table
+    // returned.
+    std::vector<pt::SourceSpan> spans_;
+    std::vector<std::size_t> slots_;
+    std::vector<pt::SourceLookup> lookups_;
+
     // Backs any oov phrases that are passed through.  
     util::Pool passthrough_pool_;
 
@@ -129,11 +259,27 @@ class Chart {
     std::vector<TargetPhrases*> entries_;
 
     const std::size_t max_source_phrase_length_;
-    const std::size_t cached_phrase_max_length_ = 2;
 
-    // TODO replace with something better, possibly remove totally.
-    // or at least pre-fill and make constant
+    // Rows read from each lookup.  No limit is stored as the maximum.
+    const std::size_t table_limit_;
+
+    const std::size_t lazy_lm_;
+
+    // Scratch for lazy_lm_: target phrases of a lookup with the score of
+    // everything but the language model, and a min heap of the best
+    // lazy_lm_ full scores.
+    struct Bounded {
+      TargetPhrase *phrase;
+      float bound;
+    };
+    std::vector<Bounded> bounded_;
+    std::vector<float> best_;
+
     VertexCache &cache_;
+    // Cache entries in use by this sentence, released on destruction.
+    std::vector<VertexCache::Entry*> pinned_;
+
+    Stats stats_;
 };
 
 } // namespace decode
@@ -58,7 +58,7 @@ BOOST_AUTO_TEST_CASE(InitTest) {
   objective.RegisterLanguageModel(feature_mock);
   BaseVocab base_vocab;
   base_vocab.map.push_back(nullptr);
-  Chart::VertexCache cache;
+  VertexCache cache;
   Chart chart(13, base_vocab, objective, cache);
   BOOST_CHECK_EQUAL(13, chart.MaxSourcePhraseLength());
 }
@@ -74,7 +74,7 @@ BOOST_AUTO_TEST_CASE(EosTest) {
   objective.RegisterLanguageModel(feature_mock);
   BaseVocab base_vocab;
   base_vocab.map.push_back(nullptr);
-  Chart::VertexCache cache;
+  VertexCache cache;
   Chart chart(11, base_vocab, objective, cache);
 
   TargetPhrases &eos = chart.EndOfSentence();
@@ -106,7 +106,7 @@ BOOST_AUTO_TEST_CASE(ReadSentenceTest) {
     base_vocab.map.push_back(nullptr);
   }
   base_vocab.map.push_back(word_small);
-  Chart::VertexCache cache;
+  VertexCache cache;
   Chart chart(5, base_vocab, objective, cache);
 
   // test known and unknown
@@ -129,5 +129,36 @@ BOOST_AUTO_TEST_CASE(ReadSentenceTest) {
   BOOST_CHECK_EQUAL("test", rep_buffer[1]);
 }
 
+BOOST_AUTO_TEST_CASE(ClearTest) {
+  pt::FieldConfig config;
+  pt::Access access(config);
+  lm::ngram::State lm_state;
+  Objective objective(access, lm_state);
+  std::vector<StringPiece> rep_buffer;
+  std::vector<VocabWord*> word_buffer;
+  FeatureMock feature_mock(rep_buffer, word_buffer);
+  objective.AddFeature(feature_mock);
+  objective.RegisterLanguageModel(feature_mock);
+  BaseVocab base_vocab;
+  base_vocab.map.push_back(nullptr);
+  const std::size_t orig_vocabsize = base_vocab.vocab.Size();
+  VertexCache cache;
+  Chart chart(5, base_vocab, objective, cache);
+
+  chart.ReadSentence("one two");
+  BOOST_CHECK_EQUAL(2, chart.SentenceLength());
+  chart.Clear();
+  BOOST_CHECK_EQUAL(0, chart.SentenceLength());
+
+  // Oov ids start over and the words are created again.
+  chart.ReadSentence("three two one");
+  BOOST_CHECK_EQUAL(3, chart.SentenceLength());
+  BOOST_CHECK_EQUAL("three", chart.VocabMapping().String(orig_vocabsize));
+  BOOST_CHECK_EQUAL("one", chart.VocabMapping().String(orig_vocabsize + 2));
+  BOOST_CHECK_EQUAL(5, word_buffer.size());
+  BOOST_CHECK_EQUAL(word_buffer[2], chart.Sentence()[0]);
+  BOOST_CHECK_EQUAL(word_buffer[4], chart.Sentence()[2]);
+}
+
 } // namespace
 } // namespace decode
@@ -4,57 +4,80 @@
 #include "util/murmur_hash.hh"
 
 #include <algorithm>
-#include <iosfwd>
+#include <ostream>
 
 #include <assert.h>
 #include <stdint.h>
 
 namespace util { class Pool; }
 
+// Width of the coverage window in bits, which bounds the reordering limit.
+// Set at compile time with -DDECODE_COVERAGE_BITS=128 etc.
+#ifndef DECODE_COVERAGE_BITS
+#define DECODE_COVERAGE_BITS 64
+#endif
+
 namespace decode {
 
-// TODO: coverage longer than 64 bits, which is needed if max_phrase + distortion > 64
-class Coverage {
+/* Source words covered by a hypothesis.  Everything before first_zero_ is
+ * covered; bits_ holds Words * 64 bits after that.  Anything beyond is
+ * assumed to be zero due to the reordering window, so the window
+ * (max(reordering limit, phrase length)) must be at most kBits.
+ *
+ * This is stored by value in Hypothesis, which is copied with memcpy, so it
+ * has no dynamic storage.
+ */
+template <unsigned Words> class BasicCoverage {
   public:
-    Coverage() : first_zero_(0), bits_(0) {}
+    static const std::size_t kBits = Words * 64;
+
+    BasicCoverage() : first_zero_(0) {
+      std::fill(bits_, bits_ + Words, 0);
+    }
 
-    bool operator==(const Coverage &other) const {
-      return (first_zero_ == other.first_zero_) && (bits_ == other.bits_);
+    bool operator==(const BasicCoverage &other) const {
+      return (first_zero_ == other.first_zero_) && std::equal(bits_, bits_ + Words, other.bits_);
     }
 
     void Set(std::size_t begin, std::size_t end) {
       assert(Compatible(begin, end));
       if (begin == first_zero_) {
         first_zero_ = end;
-        bits_ >>= (end - begin);
-        while (bits_ & 1) {
-          ++first_zero_;
-          bits_ >>= 1;
-        }
+        ShiftRight(end - begin);
+        std::size_t ones = TrailingOnes();
+        first_zero_ += ones;
+        ShiftRight(ones);
       } else {
-        bits_ |= Pattern(begin, end);
+        SetBits(begin - first_zero_, end - first_zero_);
       }
     }
 
     bool Compatible(std::size_t begin, std::size_t end) const {
-      return (begin >= first_zero_) && !(Pattern(begin, end) & bits_);
+      return (begin >= first_zero_) && !AnyBits(begin - first_zero_, end - first_zero_);
     }
 
     std::size_t FirstZero() const { return first_zero_; }
 
     // The following two functions find gaps.
     // When a phrase [begin, end) is to be covered,
-    //   [LeftOpen(begin), RightOpen(end, sentence_length)) 
+    //   [LeftOpen(begin), RightOpen(end, sentence_length))
     // indicates the larger gap in which the phrase sits.
     // Find the left bound of the gap in which the phrase [begin, ...) sits.
-    // TODO: integer log2 optimization?
     std::size_t LeftOpen(std::size_t begin) const {
-      for (std::size_t i = begin - first_zero_; i; --i) {
-        if (bits_ & (1ULL << i)) {
-          assert(Compatible(i + first_zero_ + 1, begin));
-          assert(!Compatible(i + first_zero_, begin));
-          return i + first_zero_ + 1;
+      assert(begin >= first_zero_);
+      // Highest 1 at or below begin.  Bit 0 is always 0.
+      std::size_t limit = std::min(begin - first_zero_, kBits - 1);
+      std::size_t word = limit / 64;
+      uint64_t masked = bits_[word] & LowMask(limit % 64 + 1);
+      while (true) {
+        if (masked) {
+          std::size_t ret = word * 64 + 63 - __builtin_clzll(masked) + first_zero_ + 1;
+          assert(Compatible(ret, begin));
+          assert(!Compatible(ret - 1, begin));
+          return ret;
         }
+        if (!word) break;
+        masked = bits_[--word];
       }
       assert(Compatible(first_zero_, begin));
       return first_zero_;
@@ -62,35 +85,92 @@ class Coverage {
 
     // Find the right bound of the gap in which the phrase [..., end) sits.  This bit is a 1 or end of sentence.
     std::size_t RightOpen(std::size_t end, std::size_t sentence_length) const {
-      for (std::size_t i = end - first_zero_; i < std::min((size_t)64, sentence_length - first_zero_); ++i) {
-        if (bits_ & (1ULL << i)) {
-          return i + first_zero_;
+      std::size_t from = end - first_zero_;
+      std::size_t to = std::min(kBits, sentence_length - first_zero_);
+      if (from >= to) return sentence_length;
+      std::size_t word = from / 64;
+      uint64_t masked = bits_[word] & ~LowMask(from % 64);
+      while (true) {
+        if (masked) {
+          std::size_t ret = word * 64 + __builtin_ctzll(masked);
+          return ret < to ? ret + first_zero_ : sentence_length;
         }
+        if (++word == Words) return sentence_length;
+        masked = bits_[word];
       }
-      return sentence_length;
     }
 
   private:
-    friend inline uint64_t hash_value(const Coverage &coverage) {
-      return util::MurmurHashNative(&coverage.first_zero_, sizeof(coverage.first_zero_), coverage.bits_);
+    friend inline uint64_t hash_value(const BasicCoverage &coverage) {
+      return util::MurmurHashNative(coverage.bits_, sizeof(coverage.bits_), coverage.first_zero_);
     }
 
-    friend std::ostream &operator<<(std::ostream &stream, const Coverage &coverage);
+    template <unsigned W> friend std::ostream &operator<<(std::ostream &stream, const BasicCoverage<W> &coverage);
 
-    inline uint64_t Pattern(std::size_t begin, std::size_t end) const {
-      assert(begin >= first_zero_);
-      assert(end - first_zero_ < 64);
-      // 1 in the bits.
-      return (1ULL << (end - first_zero_)) - (1ULL << (begin - first_zero_));
+    // Bits [0, count) set.
+    static uint64_t LowMask(std::size_t count) {
+      return count >= 64 ? ~static_cast<uint64_t>(0) : ((static_cast<uint64_t>(1) << count) - 1);
+    }
+
+    // 1s in [begin, end) of word, which are relative to the word.
+    static uint64_t Pattern(std::size_t begin, std::size_t end) {
+      return LowMask(end) & ~LowMask(begin);
+    }
+
+    void SetBits(std::size_t begin, std::size_t end) {
+      assert(end <= kBits);
+      for (std::size_t word = begin / 64; word * 64 < end; ++word) {
+        bits_[word] |= Pattern(std::max(begin, word * 64) - word * 64, std::min(end - word * 64, (std::size_t)64));
+      }
+    }
+
+    bool AnyBits(std::size_t begin, std::size_t end) const {
+      assert(end <= kBits);
+      for (std::size_t word = begin / 64; word * 64 < end; ++word) {
+        if (bits_[word] & Pattern(std::max(begin, word * 64) - word * 64, std::min(end - word * 64, (std::size_t)64)))
+          return true;
+      }
+      return false;
+    }
+
+    std::size_t TrailingOnes() const {
+      std::size_t ret = 0;
+      for (std::size_t word = 0; word < Words; ++word, ret += 64) {
+        if (~bits_[word]) return ret + __builtin_ctzll(~bits_[word]);
+      }
+      return ret;
+    }
+
+    void ShiftRight(std::size_t count) {
+      assert(count <= kBits);
+      std::size_t words = count / 64, bits = count % 64;
+      for (std::size_t i = 0; i < Words; ++i) {
+        uint64_t low = (i + words < Words) ? bits_[i + words] : 0;
+        uint64_t high = (i + words + 1 < Words) ? bits_[i + words + 1] : 0;
+        bits_[i] = bits ? ((low >> bits) | (high << (64 - bits))) : low;
+      }
     }
 
     std::size_t first_zero_;
-    // Bits with the first zero removed.  
-    // We also assume anything beyond this is zero due to the reordering window.
+    // Bits with the first zero removed.
     // Lowest bits correspond to next word.
-    uint64_t bits_;
+    uint64_t bits_[Words];
 };
 
+template <unsigned Words> const std::size_t BasicCoverage<Words>::kBits;
+
+template <unsigned Words> std::ostream &operator<<(std::ostream &stream, const BasicCoverage<Words> &coverage) {
+  for (std::size_t i = 0; i < coverage.FirstZero(); ++i) {
+    stream << '1';
+  }
+  for (std::size_t i = 0; i < BasicCoverage<Words>::kBits; ++i) {
+    stream << ((coverage.bits_[i / 64] >> (i % 64)) & 1);
+  }
+  return stream;
+}
+
+typedef BasicCoverage<(DECODE_COVERAGE_BITS + 63) / 64> Coverage;
+
 } // namespace decode
 
 #endif // DECODE_COVERAGE
@@ -24,5 +24,35 @@ BOOST_AUTO_TEST_CASE(LeftOpen) {
   BOOST_CHECK_EQUAL(40, coverage.RightOpen(3, 40));
 }
 
+BOOST_AUTO_TEST_CASE(Wide) {
+  BasicCoverage<4> coverage;
+  BOOST_CHECK_EQUAL(256u, BasicCoverage<4>::kBits);
+  coverage.Set(100, 101);
+  coverage.Set(200, 202);
+  BOOST_CHECK_EQUAL(0, coverage.FirstZero());
+  BOOST_CHECK(!coverage.Compatible(60, 150));
+  BOOST_CHECK(coverage.Compatible(101, 200));
+  BOOST_CHECK_EQUAL(0, coverage.LeftOpen(99));
+  BOOST_CHECK_EQUAL(101, coverage.LeftOpen(150));
+  BOOST_CHECK_EQUAL(202, coverage.LeftOpen(255));
+  BOOST_CHECK_EQUAL(100, coverage.RightOpen(5, 300));
+  BOOST_CHECK_EQUAL(200, coverage.RightOpen(150, 300));
+  BOOST_CHECK_EQUAL(300, coverage.RightOpen(202, 300));
+
+  // Filling the start shifts across words.
+  coverage.Set(0, 100);
+  BOOST_CHECK_EQUAL(101, coverage.FirstZero());
+  BOOST_CHECK_EQUAL(101, coverage.LeftOpen(150));
+  BOOST_CHECK_EQUAL(200, coverage.RightOpen(101, 300));
+  coverage.Set(101, 200);
+  BOOST_CHECK_EQUAL(202, coverage.FirstZero());
+  BOOST_CHECK(coverage == coverage);
+
+  BasicCoverage<4> other;
+  other.Set(0, 202);
+  BOOST_CHECK(coverage == other);
+  BOOST_CHECK_EQUAL(hash_value(coverage), hash_value(other));
+}
+
 } // namespace
 } // namespace decode
@@ -0,0 +1,113 @@
+#include "decode/decode.hh"
+
+#include "decode/lattice.hh"
+#include "decode/nbest.hh"
+#include "decode/system.hh"
+#include "pt/query.hh"
+#include "pt/statistics.hh"
+#include "util/file_piece.hh"
+#include "util/string_stream.hh"
+
+#include <exception>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace decode {
+
+Workspace::Workspace(System &system, const pt::Table &table, VertexCache &cache)
+  : chart(table.Stats().max_source_phrase_length, system.GetBaseVocab(), system.GetObjective(), cache, system.GetConfig().table_limit, system.GetConfig().lazy_lm) {}
+
+void Decode(System &system, const pt::Table &table, Workspace &workspace,
+    const StringPiece in, const OutputOptions &options, Translation &translation) {
+  util::StringStream &out = translation.output;
+  util::StringStream &log = translation.log;
+  Stats &stats = translation.stats;
+  stats = Stats();
+  StatsClock clock;
+  Chart &chart = workspace.chart;
+  chart.ReadSentence(in);
+  chart.LoadPhrases(table);
+  clock.Lap(stats.chart_seconds);
+  Stacks &stacks = workspace.stacks;
+  stacks.Decode(system, chart);
+  clock.Lap(stats.search_seconds);
+  const Hypothesis *hyp = stacks.End();
+
+  ScoreHistoryMap &history_map = workspace.history_map;
+  history_map.clear();
+
+  if (hyp) {
+    Output(*hyp, chart.VocabMapping(), history_map, out, system.GetObjective().GetFeatureInit(), options.verbose);
+    log << "score: " << hyp->GetScore() << '\n';
+  }
+  const Config &config = system.GetConfig();
+  if (config.beam_threshold != std::numeric_limits<float>::infinity() || config.coverage_limit) {
+    log << "skipped edges: " << stacks.SkippedEdges() << '\n';
+  }
+  out << '\n';
+
+  if (options.nbest && hyp) {
+    std::vector<Derivation> derivations;
+    NBest(*hyp, options.nbest, derivations);
+    OutputNBest(translation.sequence, derivations, chart.VocabMapping(), system.GetObjective(), translation.nbest);
+  }
+
+  if (options.lattice) {
+    OutputLattice(translation.sequence, stacks, chart.VocabMapping(), system.GetObjective().GetFeatureInit(), translation.lattice);
+  }
+
+  if (options.verbose && hyp) {
+    std::vector<float> feature_values(system.GetObjective().weights.size());
+    while (hyp->Previous() && hyp->Target()) {
+      std::size_t i = 0;
+      for (float v : system.GetObjective().GetFeatureValues(*hyp)) {
+        feature_values[i++] += v;
+      }
+      hyp = hyp->Previous();
+    }
+    log << "feature values (weighted): [ \n";
+    std::size_t i = 0;
+    for (auto value : feature_values) {
+      log << system.GetObjective().FeatureDescription(i) << ": " << value <<
+        " (" << value * system.GetObjective().weights[i] << ")\n";
+      i++;
+    }
+    log << "]\n";
+  }
+  stats.Add(chart.GetStats());
+  stats.Add(stacks.GetStats());
+  // Release the cache entries this sentence pinned.
+  chart.Clear();
+  clock.Lap(stats.output_seconds);
+}
+
+void TryDecode(System &system, const pt::Table &table, Workspace &workspace,
+    const StringPiece in, const OutputOptions &options, Translation &translation) {
+  translation.error.clear();
+  try {
+    Decode(system, table, workspace, in, options, translation);
+  } catch (const std::exception &e) {
+    translation.error = e.what();
+    if (translation.error.empty()) translation.error = "unknown exception";
+    translation.output.str(std::string());
+    translation.nbest.str(std::string());
+    translation.lattice.str(std::string());
+    translation.output << '\n';
+    // Release what the sentence pinned in the cache.
+    workspace.chart.Clear();
+  }
+}
+
+void PrewarmCache(System &system, const pt::Table &table, VertexCache &cache, util::FilePiece &in) {
+  cache.SetPermanent(true);
+  Chart chart(table.Stats().max_source_phrase_length, system.GetBaseVocab(), system.GetObjective(), cache, system.GetConfig().table_limit, system.GetConfig().lazy_lm);
+  for (StringPiece line : in) {
+    chart.ReadSentence(line);
+    chart.LoadPhrases(table);
+    chart.Clear();
+  }
+  cache.SetPermanent(false);
+}
+
+} // namespace decode
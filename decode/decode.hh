@@ -0,0 +1,79 @@
+#pragma once
+
+#include "decode/chart.hh"
+#include "decode/output.hh"
+#include "decode/stacks.hh"
+#include "decode/stats.hh"
+#include "util/string_piece.hh"
+#include "util/string_stream.hh"
+
+#include <string>
+
+#include <stdint.h>
+
+namespace pt { class Table; }
+namespace util { class FilePiece; }
+
+namespace decode {
+
+class System;
+
+// What to produce for each sentence besides the best translation.
+struct OutputOptions {
+  bool verbose = false;
+  // Size of n-best lists, 0 for none.  Requires the objective to store
+  // feature values.
+  std::size_t nbest = 0;
+  // Write the search graph.
+  bool lattice = false;
+};
+
+// A sentence and the results of translating it.
+struct Translation {
+  uint64_t sequence;
+  std::string input;
+  util::StringStream output;
+  // Moses-format n-best list if requested.
+  util::StringStream nbest;
+  // Search graph if requested, see OutputLattice.
+  util::StringStream lattice;
+  Stats stats;
+  util::StringStream log;
+  // Why decoding failed, empty if it did not.  output is then an empty line.
+  std::string error;
+};
+
+/* Memory for decoding that is reused from sentence to sentence, so a thread
+ * stops allocating once it has seen its longest sentence.  Each decoding
+ * thread needs its own.
+ */
+struct Workspace {
+  Workspace(System &system, const pt::Table &table, VertexCache &cache);
+
+  Chart chart;
+  Stacks stacks;
+  ScoreHistoryMap history_map;
+};
+
+/* Translate one sentence, appending the results to translation, which must
+ * have its sequence set.  System and table are only read and the cache is
+ * thread-safe, so multiple threads may call this at the same time provided
+ * each has its own workspace.
+ */
+void Decode(System &system, const pt::Table &table, Workspace &workspace,
+    const StringPiece in, const OutputOptions &options, Translation &translation);
+
+/* Decode, but if the sentence throws, only it fails: translation.error says
+ * why, the output is an empty line, and the workspace is ready for the next
+ * sentence.
+ */
+void TryDecode(System &system, const pt::Table &table, Workspace &workspace,
+    const StringPiece in, const OutputOptions &options, Translation &translation);
+
+/* Fill the cache before decoding.  Each line of in is a source phrase, usually
+ * a frequent n-gram, whose subphrases up to cache.MaxPhraseLength() words are
+ * scored and cached permanently.
+ */
+void PrewarmCache(System &system, const pt::Table &table, VertexCache &cache, util::FilePiece &in);
+
+} // namespace decode
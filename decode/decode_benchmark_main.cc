@@ -0,0 +1,346 @@
+// End-to-end decoder throughput.  Builds a synthetic phrase table with
+// pt::CreateTable and a synthetic trigram language model, or loads real ones,
+// then decodes the same sentences for each combination of beam size and
+// reordering limit.  Reports words per second, time per stage, and peak RSS.
+#include "decode/decode.hh"
+#include "decode/system.hh"
+#include "decode/vertex_cache.hh"
+#include "decode/weights.hh"
+#include "pt/access.hh"
+#include "pt/create.hh"
+#include "pt/query.hh"
+#include "pt/statistics.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+#include "util/file_piece.hh"
+#include "util/file_stream.hh"
+#include "util/usage.hh"
+
+// features
+#include "decode/distortion.hh"
+#include "decode/word_insert.hh"
+#include "decode/passthrough.hh"
+#include "decode/phrase_count_feature.hh"
+#include "decode/pt_features.hh"
+#include "decode/lm.hh"
+#include "decode/lexro.hh"
+
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+
+typedef boost::random::mt19937 Generator;
+
+struct SyntheticConfig {
+  std::size_t vocab;
+  std::size_t phrases;
+  std::size_t max_phrase_length;
+  std::size_t targets;
+  std::size_t lm_ngrams;
+};
+
+typedef std::vector<std::size_t> Phrase;
+
+// Source phrases: every word, then random longer ones.  Sorted so phrases
+// with the same source are adjacent as CreateTable requires.
+std::set<Phrase> SourcePhrases(const SyntheticConfig &config, Generator &gen) {
+  std::set<Phrase> ret;
+  for (std::size_t i = 0; i < config.vocab; ++i) {
+    ret.insert(Phrase(1, i));
+  }
+  boost::random::uniform_int_distribution<std::size_t> word(0, config.vocab - 1);
+  boost::random::uniform_int_distribution<std::size_t> length(2, std::max<std::size_t>(2, config.max_phrase_length));
+  if (config.max_phrase_length < 2) return ret;
+  for (std::size_t i = 0; i < config.phrases; ++i) {
+    Phrase phrase(length(gen));
+    for (std::size_t &w : phrase) w = word(gen);
+    ret.insert(phrase);
+  }
+  return ret;
+}
+
+// Text phrase table with 5 dense features and 6 lexicalized reordering
+// scores to match example/test.weights.
+void WritePhraseTable(const SyntheticConfig &config, const std::set<Phrase> &sources, Generator &gen, int fd) {
+  util::FileStream out(fd);
+  boost::random::uniform_int_distribution<std::size_t> word(0, config.vocab - 1);
+  boost::random::uniform_int_distribution<std::size_t> targets(1, config.targets);
+  boost::random::uniform_int_distribution<std::size_t> target_length(1, 3);
+  boost::random::uniform_real_distribution<float> prob(0.01, 1.0);
+  for (const Phrase &source : sources) {
+    for (std::size_t t = targets(gen); t; --t) {
+      for (std::size_t w : source) {
+        out << 's' << w << ' ';
+      }
+      out << "|||";
+      for (std::size_t i = target_length(gen); i; --i) {
+        out << " t" << word(gen);
+      }
+      out << " |||";
+      for (unsigned int i = 0; i < 5; ++i) out << ' ' << prob(gen);
+      out << " |||";
+      for (unsigned int i = 0; i < 6; ++i) out << ' ' << prob(gen);
+      out << '\n';
+    }
+  }
+}
+
+// ARPA trigram model over the target words with random probabilities.
+// Trigrams only extend existing bigrams so every context is present.
+void WriteLM(const SyntheticConfig &config, Generator &gen, int fd) {
+  util::FileStream out(fd);
+  const std::size_t kEOS = config.vocab + 1;
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < config.vocab; ++i) {
+    names.push_back("t" + std::to_string(i));
+  }
+  names.push_back("<s>");
+  names.push_back("</s>");
+
+  // Contexts include <s>.
+  boost::random::uniform_int_distribution<std::size_t> context(0, config.vocab), predict(0, config.vocab - 1);
+  boost::random::uniform_real_distribution<float> prob(-3.0, -0.1), backoff(-1.0, 0.0);
+  std::set<std::pair<std::size_t, std::size_t> > bigrams;
+  for (std::size_t i = 0; i < config.lm_ngrams; ++i) {
+    std::size_t first = context(gen), second = predict(gen);
+    // Occasionally end the sentence.
+    if (!(i % 10)) second = kEOS;
+    bigrams.insert(std::make_pair(first, second));
+  }
+  boost::unordered_map<std::size_t, std::vector<std::size_t> > following;
+  std::vector<std::pair<std::size_t, std::size_t> > bigram_list(bigrams.begin(), bigrams.end());
+  for (const std::pair<std::size_t, std::size_t> &b : bigram_list) {
+    following[b.first].push_back(b.second);
+  }
+  std::set<std::vector<std::size_t> > trigrams;
+  boost::random::uniform_int_distribution<std::size_t> pick_bigram(0, bigram_list.size() - 1);
+  for (std::size_t i = 0; i < config.lm_ngrams && !bigram_list.empty(); ++i) {
+    const std::pair<std::size_t, std::size_t> &b = bigram_list[pick_bigram(gen)];
+    boost::unordered_map<std::size_t, std::vector<std::size_t> >::const_iterator next = following.find(b.second);
+    if (next == following.end()) continue;
+    boost::random::uniform_int_distribution<std::size_t> pick(0, next->second.size() - 1);
+    std::vector<std::size_t> trigram = {b.first, b.second, next->second[pick(gen)]};
+    trigrams.insert(trigram);
+  }
+
+  out << "\n\\data\\\nngram 1=" << (config.vocab + 3) << "\nngram 2=" << bigrams.size() << "\nngram 3=" << trigrams.size() << "\n\n\\1-grams:\n";
+  out << "-1.5\t<unk>\t0\n-99\t<s>\t" << backoff(gen) << "\n-1.0\t</s>\t0\n";
+  for (std::size_t i = 0; i < config.vocab; ++i) {
+    out << prob(gen) << '\t' << names[i] << '\t' << backoff(gen) << '\n';
+  }
+  out << "\n\\2-grams:\n";
+  for (const std::pair<std::size_t, std::size_t> &b : bigrams) {
+    out << prob(gen) << '\t' << names[b.first] << ' ' << names[b.second];
+    if (b.second != kEOS) out << '\t' << backoff(gen);
+    out << '\n';
+  }
+  out << "\n\\3-grams:\n";
+  for (const std::vector<std::size_t> &t : trigrams) {
+    out << prob(gen) << '\t' << names[t[0]] << ' ' << names[t[1]] << ' ' << names[t[2]] << '\n';
+  }
+  out << "\n\\end\\\n";
+}
+
+// Sentences made by concatenating source phrases so longer phrases match.
+std::vector<std::string> Sentences(const std::set<Phrase> &sources, std::size_t count, std::size_t min_length, std::size_t max_length, Generator &gen) {
+  std::vector<const Phrase*> list;
+  for (const Phrase &p : sources) list.push_back(&p);
+  boost::random::uniform_int_distribution<std::size_t> pick(0, list.size() - 1);
+  boost::random::uniform_int_distribution<std::size_t> length(min_length, max_length);
+  std::vector<std::string> ret(count);
+  for (std::string &sentence : ret) {
+    std::size_t words = length(gen);
+    for (std::size_t i = 0; i < words;) {
+      for (std::size_t w : *list[pick(gen)]) {
+        if (i == words) break;
+        if (i++) sentence += ' ';
+        sentence += 's' + std::to_string(w);
+      }
+    }
+  }
+  return ret;
+}
+
+std::vector<std::size_t> ParseList(const std::string &str) {
+  std::vector<std::size_t> ret;
+  std::size_t start = 0;
+  while (start < str.size()) {
+    std::size_t comma = str.find(',', start);
+    if (comma == std::string::npos) comma = str.size();
+    ret.push_back(std::stoul(str.substr(start, comma - start)));
+    start = comma + 1;
+  }
+  UTIL_THROW_IF2(ret.empty(), "Empty list " << str);
+  return ret;
+}
+
+std::size_t CountWords(const std::string &sentence) {
+  std::size_t ret = 0;
+  for (std::size_t i = 0; i < sentence.size(); ++i) {
+    if (sentence[i] != ' ' && (i == 0 || sentence[i - 1] == ' ')) ++ret;
+  }
+  return ret;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    namespace po = boost::program_options;
+    po::options_description options("Decoder benchmark options");
+    std::string lm_file, phrase_file, weights_file, input_file, beams, reorderings;
+    SyntheticConfig synthetic;
+    std::size_t sentence_count, min_length, max_length;
+    unsigned int seed;
+
+    options.add_options()
+      ("weights_file,W", po::value<std::string>(&weights_file)->required(), "Weights file with 5 phrase table and 6 lexicalized reordering features for synthetic tables")
+      ("beam,K", po::value<std::string>(&beams)->default_value("50,200"), "Comma-separated beam sizes to sweep")
+      ("reordering,R", po::value<std::string>(&reorderings)->default_value("6"), "Comma-separated reordering limits to sweep")
+      ("lm,l", po::value<std::string>(&lm_file), "Language model instead of a synthetic one")
+      ("phrase,p", po::value<std::string>(&phrase_file), "Phrase table instead of a synthetic one")
+      ("input", po::value<std::string>(&input_file), "Sentences to decode instead of synthetic ones")
+      ("vocab", po::value<std::size_t>(&synthetic.vocab)->default_value(2000), "Synthetic source and target vocabulary size")
+      ("phrases", po::value<std::size_t>(&synthetic.phrases)->default_value(20000), "Synthetic multi-word source phrases")
+      ("max_phrase_length", po::value<std::size_t>(&synthetic.max_phrase_length)->default_value(3), "Longest synthetic source phrase")
+      ("targets", po::value<std::size_t>(&synthetic.targets)->default_value(10), "Most target phrases per synthetic source phrase")
+      ("lm_ngrams", po::value<std::size_t>(&synthetic.lm_ngrams)->default_value(100000), "Synthetic bigrams and trigrams to draw")
+      ("sentences", po::value<std::size_t>(&sentence_count)->default_value(50), "Synthetic sentences")
+      ("min_length", po::value<std::size_t>(&min_length)->default_value(10), "Shortest synthetic sentence in words")
+      ("max_length", po::value<std::size_t>(&max_length)->default_value(40), "Longest synthetic sentence in words")
+      ("seed", po::value<unsigned int>(&seed)->default_value(1), "Random seed");
+    if (argc == 1) {
+      std::cerr << options << std::endl;
+      return 1;
+    }
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+    UTIL_THROW_IF2(!synthetic.vocab || !synthetic.targets || min_length > max_length, "Bad synthetic sizes");
+
+    Generator gen(seed);
+    std::set<Phrase> sources;
+    if (phrase_file.empty() || input_file.empty()) {
+      sources = SourcePhrases(synthetic, gen);
+    }
+
+    double start = util::WallTime();
+    boost::scoped_ptr<pt::Table> table;
+    if (phrase_file.empty()) {
+      util::scoped_fd text(util::MakeTemp(util::DefaultTempDirectory()));
+      WritePhraseTable(synthetic, sources, gen, text.get());
+      util::SeekOrThrow(text.get(), 0);
+      util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+      pt::TextColumns columns;
+      columns.lexical_reordering = 3;
+      pt::FieldConfig fields;
+      fields.dense_features = 1;
+      fields.lexical_reordering = 1;
+      pt::CreateTable(text.release(), util::DupOrThrow(binary.get()), columns, fields);
+      util::SeekOrThrow(binary.get(), 0);
+      table.reset(new pt::Table(binary.release(), util::READ));
+    } else {
+      table.reset(new pt::Table(phrase_file.c_str(), util::READ));
+    }
+
+    boost::scoped_ptr<decode::LM> lm;
+    if (lm_file.empty()) {
+      // The model loads by name, so make a named temporary.
+      std::string name = util::DefaultTempDirectory() + "decode_benchmark_lm_XXXXXX";
+      util::scoped_fd arpa(mkstemp(&name[0]));
+      UTIL_THROW_IF(arpa.get() == -1, util::ErrnoException, "Making " << name);
+      try {
+        WriteLM(synthetic, gen, arpa.get());
+        lm.reset(new decode::LM(name.c_str()));
+      } catch (...) {
+        unlink(name.c_str());
+        throw;
+      }
+      unlink(name.c_str());
+    } else {
+      lm.reset(new decode::LM(lm_file.c_str()));
+    }
+
+    std::vector<std::string> input;
+    if (input_file.empty()) {
+      input = Sentences(sources, sentence_count, min_length, max_length, gen);
+    } else {
+      util::FilePiece in(input_file.c_str());
+      for (StringPiece line : in) {
+        input.push_back(line.as_string());
+      }
+    }
+    std::size_t words = 0;
+    for (const std::string &sentence : input) {
+      words += CountWords(sentence);
+    }
+    std::cerr << "Built models in " << (util::WallTime() - start) << " s" << std::endl;
+
+    decode::Weights weights;
+    weights.ReadFromFile(weights_file);
+
+    std::cout << "beam\treordering\twords/s\tchart_s\tsearch_s\toutput_s\tpeak_rss_MB\n";
+    for (std::size_t beam : ParseList(beams)) {
+      for (std::size_t reordering : ParseList(reorderings)) {
+        decode::Config config;
+        config.pop_limit = beam;
+        config.reordering_limit = reordering;
+        decode::Distortion distortion;
+        decode::Passthrough passthrough;
+        decode::WordInsertion word_insert;
+        decode::PhraseCountFeature phrase_count_feature;
+        decode::PhraseTableFeatures pt_features;
+        decode::LexicalizedReordering lexro;
+
+        decode::System sys(config, table->Accessor(), weights, lm->Model());
+        sys.GetObjective().AddFeature(distortion);
+        sys.GetObjective().AddFeature(passthrough);
+        sys.GetObjective().AddFeature(word_insert);
+        sys.GetObjective().AddFeature(phrase_count_feature);
+        sys.GetObjective().AddFeature(pt_features);
+        sys.GetObjective().AddFeature(*lm);
+        sys.GetObjective().RegisterLanguageModel(*lm);
+        sys.GetObjective().AddFeature(lexro);
+        sys.LoadVocab(table->Vocab(), table->Stats().vocab_size);
+        sys.GetObjective().LoadWeights(weights);
+
+        decode::VertexCache cache;
+        decode::Workspace workspace(sys, *table, cache);
+        decode::OutputOptions output_options;
+        decode::Translation translation;
+        decode::Stats total;
+        double started = util::WallTime();
+        for (std::size_t i = 0; i < input.size(); ++i) {
+          translation.sequence = i;
+          decode::Decode(sys, *table, workspace, input[i], output_options, translation);
+          total.Add(translation.stats);
+          translation.output.str(std::string());
+          translation.log.str(std::string());
+        }
+        double elapsed = util::WallTime() - started;
+        // Stage times are zero if built without DECODE_STATS.
+        std::cout << beam << '\t' << reordering << '\t' << (words / elapsed)
+          << '\t' << total.chart_seconds << '\t' << total.search_seconds << '\t' << total.output_seconds
+          << '\t' << (util::RSSMax() / 1048576.0) << std::endl;
+      }
+    }
+    util::PrintUsage(std::cerr);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
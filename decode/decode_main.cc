@@ -1,14 +1,20 @@
 #include "decode/system.hh"
 #include "decode/chart.hh"
+#include "decode/decode.hh"
 #include "decode/output.hh"
-#include "decode/stacks.hh"
+#include "decode/prefork.hh"
+#include "decode/server.hh"
+#include "decode/thread.hh"
 #include "decode/weights.hh"
 #include "pt/query.hh"
 #include "pt/statistics.hh"
 #include "pt/access.hh"
 #include "pt/create.hh"
+#include "util/file.hh"
 #include "util/file_stream.hh"
 #include "util/mutable_vocab.hh"
+#include "util/numa.hh"
+#include "util/string_stream.hh"
 #include "util/usage.hh"
 
 // features
@@ -21,48 +27,86 @@
 #include "decode/lexro.hh"
 
 #include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
 
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
-namespace decode {
-void Decode(System &system, const pt::Table &table, Chart::VertexCache &cache,
-    const StringPiece in,
-    ScoreHistoryMap &history_map, bool verbose, util::FileStream &out) {
-  Chart chart(table.Stats().max_source_phrase_length, system.GetBaseVocab(), system.GetObjective(), cache);
-  chart.ReadSentence(in);
-  chart.LoadPhrases(table);
-  Stacks stacks(system, chart);
-  const Hypothesis *hyp = stacks.End();
-	
-  history_map.clear();
-	
-  if (hyp) {
-    Output(*hyp, chart.VocabMapping(), history_map, out, system.GetObjective().GetFeatureInit(), verbose);
-    std::cerr << "score: " << hyp->GetScore() << std::endl;
-  }
-  out << '\n';
-
-  if (verbose && hyp) {
-    std::vector<float> feature_values(system.GetObjective().weights.size());
-    while (hyp->Previous() && hyp->Target()) {
-      std::size_t i = 0;
-      for (float v : system.GetObjective().GetFeatureValues(*hyp)) {
-        feature_values[i++] += v;
-      }
-      hyp = hyp->Previous();
+namespace {
+
+util::LoadMethod ParseLoadMethod(const std::string &name) {
+  if (name == "lazy") return util::LAZY;
+  if (name == "populate") return util::POPULATE_OR_READ;
+  if (name == "read") return util::READ;
+  UTIL_THROW(util::Exception, "Unknown load method " << name << "; use lazy, populate, or read");
+}
+
+// Everything decoding reads.  With --numa there is one per node.
+struct Loaded {
+  Loaded(const std::string &phrase_file, util::LoadMethod phrase_load, const std::string &lm_file, util::LoadMethod lm_load,
+      const decode::Config &config, const decode::Weights &weights, bool store_feature_values,
+      const decode::VertexCacheConfig &cache_config, const std::string &cache_prewarm, const std::string &baked_vocab)
+    : table(phrase_file.c_str(), phrase_load),
+      lm(lm_file.c_str(), lm_load),
+      sys(config, table.Accessor(), weights, lm.Model()),
+      cache(cache_config) {
+    sys.GetObjective().AddFeature(distortion);
+    sys.GetObjective().AddFeature(passthrough);
+    sys.GetObjective().AddFeature(word_insert);
+    sys.GetObjective().AddFeature(phrase_count_feature);
+    sys.GetObjective().AddFeature(pt_features);
+    sys.GetObjective().AddFeature(lm);
+    sys.GetObjective().RegisterLanguageModel(lm);
+    sys.GetObjective().AddFeature(lexro);
+    if (table.Config().lm_state && !lm.UseTableState(table.Config())) {
+      std::cerr << "Language model state in " << phrase_file << " was made by another model, so target phrases will be scored with " << lm_file << " instead.  Run add_lm_states again to store its state." << std::endl;
+    }
+
+    if (baked_vocab.empty()) {
+      sys.LoadVocab(table.Vocab(), table.Stats().vocab_size);
+    } else {
+      sys.LoadVocab(table, lm.Checksum(), baked_vocab);
     }
-    std::cerr << "feature values (weighted): [ \n";
-    std::size_t i = 0;
-    for (auto value : feature_values) {
-      std::cerr << system.GetObjective().FeatureDescription(i) << ": " << value <<
-        " (" << value * system.GetObjective().weights[i] << ")" << std::endl;
-      i++;
+    sys.GetObjective().SetStoreFeatureValues(store_feature_values);
+    sys.GetObjective().LoadWeights(weights);
+
+    if (!cache_prewarm.empty()) {
+      util::FilePiece prewarm(cache_prewarm.c_str(), &std::cerr);
+      decode::PrewarmCache(sys, table, cache, prewarm);
     }
-    std::cerr << "]\n";
   }
+
+  pt::Table table;
+
+  decode::Distortion distortion;
+  decode::Passthrough passthrough;
+  decode::WordInsertion word_insert;
+  decode::PhraseCountFeature phrase_count_feature;
+  decode::PhraseTableFeatures pt_features;
+  decode::LM lm;
+  decode::LexicalizedReordering lexro;
+
+  decode::System sys;
+  decode::VertexCache cache;
+};
+
+void Serve(const std::vector<decode::Replica> &replicas, const decode::OutputOptions &options, std::size_t threads, decode::Latencies &latencies, std::size_t latency_every, int in_fd, int out_fd) {
+  util::FilePiece in(in_fd);
+  util::FileStream out(out_fd);
+  decode::Server server(replicas, options, threads, out, latencies, latency_every);
+  while (true) {
+    StringPiece line;
+    try {
+      line = in.ReadLine();
+    } catch (const util::EndOfFileException &e) { break; }
+    server.Add(line);
+  }
+  // The destructor waits for every answer.
 }
-} // namespace decode
+
+} // namespace
 
 int main(int argc, char *argv[]) {
   try {
@@ -71,7 +115,14 @@ int main(int argc, char *argv[]) {
     std::string lm_file, phrase_file;
     std::string weights_file;
     decode::Config config;
-    bool verbose = false;
+    decode::OutputOptions output_options;
+    std::string nbest_file, lattice_file, stats_file;
+    std::size_t threads;
+    std::string cache_memory, cache_prewarm;
+    decode::VertexCacheConfig cache_config;
+    std::string phrase_load, lm_load, baked_vocab;
+    bool numa, server;
+    std::size_t latency_every, processes;
 
     options.add_options()
       ("verbose,v", "Produce verbose output")
@@ -79,7 +130,26 @@ int main(int argc, char *argv[]) {
       ("phrase,p", po::value<std::string>(&phrase_file)->required(), "Phrase table")
       ("weights_file,W", po::value<std::string>(&weights_file)->required(), "Weights file")
       ("beam,K", po::value<unsigned int>(&config.pop_limit)->required(), "Beam size")
-      ("reordering,R", po::value<std::size_t>(&config.reordering_limit)->required(), "Reordering limit");
+      ("reordering,R", po::value<std::size_t>(&config.reordering_limit)->required(), "Reordering limit")
+      ("beam_threshold", po::value<float>(&config.beam_threshold), "Only extend hypotheses within this score of the best in their stack")
+      ("table_limit", po::value<std::size_t>(&config.table_limit)->default_value(0), "Load at most this many target phrases per source phrase, 0 for no limit.  Binarize the table with --weights so these are the best")
+      ("lazy_lm", po::value<std::size_t>(&config.lazy_lm)->default_value(0), "Score target phrases with the language model in order of their other features, stopping once this many best per source phrase are known.  0 scores them all")
+      ("coverage_limit", po::value<std::size_t>(&config.coverage_limit)->default_value(0), "Extend at most this many hypotheses per coverage in each stack, 0 for no limit")
+      ("nbest,n", po::value<std::size_t>(&output_options.nbest)->default_value(0), "Size of n-best lists, 0 to disable")
+      ("nbest_file", po::value<std::string>(&nbest_file), "Write Moses-format n-best lists here")
+      ("lattice_file", po::value<std::string>(&lattice_file), "Write search graphs here in OpenFST text format, each preceded by the sentence number")
+      ("stats", po::value<std::string>(&stats_file), "Write profiling counters and timers here as JSON lines, one per sentence then the total")
+      ("threads,t", po::value<std::size_t>(&threads)->default_value(1), "Sentences to decode in parallel")
+      ("cache_memory", po::value<std::string>(&cache_memory)->default_value("1G"), "Memory for cached short phrases, with suffix like 1G")
+      ("cache_phrase_length", po::value<std::size_t>(&cache_config.max_phrase_length)->default_value(2), "Cache source phrases up to this length")
+      ("cache_prewarm", po::value<std::string>(&cache_prewarm), "Source n-grams to cache permanently at startup, one per line")
+      ("phrase_load", po::value<std::string>(&phrase_load)->default_value("read"), "Load the phrase table with lazy or populate mmap, or read it into memory backed by huge pages when the kernel has them")
+      ("lm_load", po::value<std::string>(&lm_load)->default_value("populate"), "Load the language model like --phrase_load")
+      ("baked_vocab", po::value<std::string>(&baked_vocab), "Map the phrase table vocabulary and its language model ids from this file instead of loading them.  If the file is missing or was made for another table, language model, or features, load as usual and write it")
+      ("numa", po::bool_switch(&numa), "Load a copy of the models on each NUMA node, up to --threads, and run each decoding thread on the node of its copy.  Only read models are copied; mmapped files share the page cache")
+      ("server", po::bool_switch(&server), "Keep running and answer each input line id<TAB>sentence with id<TAB>translation as soon as it is done, possibly out of order.  Lines without a tab are numbered from 0.  Does not write n-best lists, lattices, or stats")
+      ("latency_every", po::value<std::size_t>(&latency_every)->default_value(0), "With --server, report latency percentiles to stderr every this many requests as well as at the end, 0 for only at the end")
+      ("processes", po::value<std::size_t>(&processes)->default_value(1), "With --server, fork this many worker processes, each with --threads threads, after loading.  They share the loaded models copy-on-write; load with --phrase_load populate and --lm_load populate to share them with other decoders as well");
     if (argc == 1) {
       std::cerr << options << std::endl;
       return 1;
@@ -87,55 +157,108 @@ int main(int argc, char *argv[]) {
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, options), vm);
     po::notify(vm);
+    UTIL_THROW_IF2(threads == 0, "Need at least one thread");
+    cache_config.memory = util::ParseSize(cache_memory);
 
     if(vm.count("verbose")) {
-        verbose = true;
+        output_options.verbose = true;
     }
-
-    pt::Table table(phrase_file.c_str(), util::READ);
+    UTIL_THROW_IF2(output_options.nbest && nbest_file.empty(), "--nbest needs --nbest_file");
+    output_options.lattice = !lattice_file.empty();
+#ifndef DECODE_STATS
+    UTIL_THROW_IF2(!stats_file.empty(), "--stats needs a build with -DDECODE_STATS=ON");
+#endif
+    UTIL_THROW_IF2(processes == 0, "Need at least one process");
+    UTIL_THROW_IF2(processes > 1 && !server, "--processes needs --server");
+    UTIL_THROW_IF2(server && (output_options.nbest || output_options.lattice || !stats_file.empty()), "--server does not write n-best lists, lattices, or stats");
 
     decode::Weights weights;
     weights.ReadFromFile(weights_file);
-    decode::Distortion distortion;
-    decode::Passthrough passthrough;
-    decode::WordInsertion word_insert;
-    decode::PhraseCountFeature phrase_count_feature;
-    decode::PhraseTableFeatures pt_features;
-    decode::LM lm(lm_file.c_str());
-    decode::LexicalizedReordering lexro;
-
-    decode::System sys(config, table.Accessor(), weights, lm.Model());
-    sys.GetObjective().AddFeature(distortion);
-    sys.GetObjective().AddFeature(passthrough);
-    sys.GetObjective().AddFeature(word_insert);
-    sys.GetObjective().AddFeature(phrase_count_feature);
-    sys.GetObjective().AddFeature(pt_features);
-    sys.GetObjective().AddFeature(lm);
-    sys.GetObjective().RegisterLanguageModel(lm);
-    sys.GetObjective().AddFeature(lexro);
 
-    sys.LoadVocab(table.Vocab(), table.Stats().vocab_size);
-    sys.GetObjective().SetStoreFeatureValues(verbose);
-    sys.GetObjective().LoadWeights(weights);
+    // Each copy is loaded by this thread bound to its node so that read
+    // memory is allocated there.
+    std::vector<std::unique_ptr<Loaded> > loaded(numa ? std::min(util::NumaNodes(), threads) : 1);
+    for (std::size_t node = 0; node < loaded.size(); ++node) {
+      if (numa) util::BindToNumaNode(node);
+      loaded[node].reset(new Loaded(phrase_file, ParseLoadMethod(phrase_load), lm_file, ParseLoadMethod(lm_load),
+            config, weights, output_options.verbose || output_options.nbest, cache_config, cache_prewarm, baked_vocab));
+    }
+    // A single thread decodes here, next to the first copy.
+    if (numa && (threads > 1 || server)) util::UnbindNuma();
+    decode::System &sys = loaded.front()->sys;
+    const pt::Table &table = loaded.front()->table;
+
+    std::vector<decode::Replica> replicas;
+    for (std::size_t node = 0; node < loaded.size(); ++node) {
+      decode::Replica replica = {&loaded[node]->sys, &loaded[node]->table, &loaded[node]->cache, numa ? node : decode::Replica::kAnyNode};
+      replicas.push_back(replica);
+    }
+    if (server) {
+      decode::Latencies latencies;
+      if (processes == 1) {
+        Serve(replicas, output_options, threads, latencies, latency_every, 0, 1);
+      } else {
+        // The parent measures latency over all workers.
+        decode::PreforkServe(processes, 0, 1, [&](int requests, int answers) {
+          decode::Latencies ignored;
+          Serve(replicas, output_options, threads, ignored, 0, requests, answers);
+        }, latencies, latency_every);
+      }
+      latencies.Report(std::cerr);
+      util::PrintUsage(std::cerr);
+      return 0;
+    }
 
     util::FilePiece f(0, NULL, &std::cerr);
     util::FileStream out(1);
-    decode::Chart::VertexCache cache(15000000); // TODO non-hardcode
-    // TODO vocab map originally exists to avoid having a global dictionary.
-    // it is now here because we need backing for cache, which only exists
-    // to make speed comparable to the previous mtplz
-    decode::ScoreHistoryMap history_map;
-    std::size_t i = 0;
-    while (true) {
-      StringPiece line;
-      try {
-        line = f.ReadLine();
-      } catch (const util::EndOfFileException &e) { break; }
-      util::PrintUsage(std::cerr);
-      std::cerr << "sentence " << i++ << std::endl;
-      decode::Decode(sys, table, cache, line, history_map, verbose, out);
-      out.flush();
-      f.UpdateProgress();
+    util::scoped_fd nbest_fd, lattice_fd, stats_fd;
+    boost::scoped_ptr<util::FileStream> nbest, lattice, stats;
+    if (output_options.nbest) {
+      nbest_fd.reset(util::CreateOrThrow(nbest_file.c_str()));
+      nbest.reset(new util::FileStream(nbest_fd.get()));
+    }
+    if (output_options.lattice) {
+      lattice_fd.reset(util::CreateOrThrow(lattice_file.c_str()));
+      lattice.reset(new util::FileStream(lattice_fd.get()));
+    }
+    decode::Stats total;
+    if (!stats_file.empty()) {
+      stats_fd.reset(util::CreateOrThrow(stats_file.c_str()));
+      stats.reset(new util::FileStream(stats_fd.get()));
+    }
+    const decode::OutputFiles files = {&out, nbest.get(), lattice.get(), stats.get(), stats ? &total : NULL};
+    uint64_t sentences = 0;
+    if (threads == 1) {
+      decode::Workspace workspace(sys, table, loaded.front()->cache);
+      decode::Translation translation;
+      while (true) {
+        StringPiece line;
+        try {
+          line = f.ReadLine();
+        } catch (const util::EndOfFileException &e) { break; }
+        translation.sequence = sentences++;
+        decode::TryDecode(sys, table, workspace, line, output_options, translation);
+        decode::WriteTranslation(translation, files);
+        f.UpdateProgress();
+      }
+    } else {
+      decode::ThreadedDecoder decoder(replicas, output_options, threads, files);
+      while (true) {
+        StringPiece line;
+        try {
+          line = f.ReadLine();
+        } catch (const util::EndOfFileException &e) { break; }
+        decoder.Add(line);
+        ++sentences;
+        f.UpdateProgress();
+      }
+    } // Wait for decoding to finish.
+    if (stats) {
+      util::StringStream line;
+      line << "{\"sentences\":" << sentences << ',';
+      total.WriteJSON(line);
+      line << "}\n";
+      *stats << line.str();
     }
     util::PrintUsage(std::cerr);
   } catch (const std::exception &e) {
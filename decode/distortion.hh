@@ -8,6 +8,10 @@ class Distortion : public Feature {
   public:
     Distortion();
 
+    ScoreMethods UsedScoreMethods() const override {
+      return kScoreHypothesisWithSourcePhrase;
+    }
+
     void Init(FeatureInit &feature_init) override;
 
     void NewWord(const StringPiece string_rep, VocabWord *word) const override {}
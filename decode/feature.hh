@@ -33,6 +33,17 @@ struct PhrasePair {
   const VocabMap *vocab_map;
 };
 
+// Bits for Feature::ScoreMethods: the per-phrase and per-hypothesis hooks a
+// feature implements.  Objective only calls a hook for features that set
+// its bit.
+typedef unsigned ScoreMethods;
+const ScoreMethods kScoreTargetPhrase = 1;
+const ScoreMethods kScoreHypothesisWithSourcePhrase = 2;
+const ScoreMethods kScoreHypothesisWithPhrasePair = 4;
+const ScoreMethods kScoreFinalHypothesis = 8;
+const ScoreMethods kHypothesisEqual = 16;
+const ScoreMethods kAllScoreMethods = 31;
+
 class Feature {
   public:
     // recommended constructor: Feature(const std::string &config);
@@ -46,6 +57,10 @@ class Feature {
     /** Add state fields to the layouts in init. */
     virtual void Init(FeatureInit &feature_init) = 0;
 
+    /** Which hooks do something.  The others are skipped when scoring, so
+     * an empty hook costs no virtual call per hypothesis. */
+    virtual ScoreMethods UsedScoreMethods() const { return kAllScoreMethods; }
+
     /** allows to save constant-length data in the word's representation */
     virtual void NewWord(const StringPiece string_rep, VocabWord *word) const = 0;
 
@@ -21,6 +21,7 @@ struct FeatureInit {
     phrase_access(phrase_accessor),
     hypothesis_field(hypothesis_layout),
     lm_state_field(hypothesis_layout),
+    recombination_field(hypothesis_layout),
     pt_id_field(word_layout),
     pt_row_field(target_phrase_layout),
     phrase_score_field(target_phrase_layout) {}
@@ -38,6 +39,11 @@ struct FeatureInit {
   util::Layout hypothesis_layout;
   const util::PODField<Hypothesis> hypothesis_field; // has to be first field
   const util::PODField<LMState> lm_state_field;
+  /** Hash of everything that decides whether two hypotheses recombine.
+    * Features mix their state in with ScoreCollector::AddRecombinationKey
+    * while scoring and HypothesisBuilder adds the coverage, source end and
+    * language model state, so the stacks never hash a hypothesis again. */
+  const util::PODField<uint64_t> recombination_field;
 
   /** Use to store information about the target phrase when scoring in
     * isolation (ScorePhrase). */
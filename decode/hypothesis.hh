@@ -32,7 +32,7 @@ struct TargetPhrase;
 class Hypothesis {
   public:
     /** STL default constructor. */
-    Hypothesis() : target_(NULL) {}
+    Hypothesis() : target_(NULL), recombined_(NULL) {}
 
     /** Extend a previous hypothesis. */
     Hypothesis(
@@ -45,7 +45,8 @@ class Hypothesis {
       pre_(previous),
       end_index_(source_end),
       target_(target),
-      coverage_(previous->coverage_) {
+      coverage_(previous->coverage_),
+      recombined_(NULL) {
       coverage_.Set(source_begin, source_end);
     }
 
@@ -55,7 +56,8 @@ class Hypothesis {
       pre_(NULL),
       end_index_(0),
       target_(target),
-      coverage_() {}
+      coverage_(),
+      recombined_(NULL) {}
 
     /** Initialize hypothesis extension for source phrase pairing */
     explicit Hypothesis(const Hypothesis *previous) :
@@ -63,7 +65,8 @@ class Hypothesis {
       pre_(previous),
       end_index_(0),
       target_(NULL),
-      coverage_() {}
+      coverage_(),
+      recombined_(NULL) {}
 
     const Coverage &GetCoverage() const { return coverage_; }
 
@@ -76,6 +79,18 @@ class Hypothesis {
 
     const TargetPhrase *Target() const { return target_; }
 
+    // Hypotheses that lost recombination to this one, linked through their
+    // own Recombined().  Kept for n-best extraction.
+    const Hypothesis *Recombined() const { return recombined_; }
+
+    // Record that other (and anything recombined into it) lost to this.
+    void AddRecombined(Hypothesis *other) {
+      Hypothesis *last = other;
+      while (last->recombined_) last = last->recombined_;
+      last->recombined_ = recombined_;
+      recombined_ = other;
+    }
+
   private:
     float score_;
 
@@ -87,6 +102,8 @@ class Hypothesis {
     const TargetPhrase *target_;
 
     Coverage coverage_;
+
+    Hypothesis *recombined_;
 };
 
 } // namespace decode
@@ -1,6 +1,17 @@
 #include "decode/hypothesis_builder.hh"
 
+#include "util/murmur_hash.hh"
+
 namespace decode {
+
+namespace {
+// Add the state every hypothesis has to the hash the features built.
+uint64_t RecombinationHash(const Hypothesis &hypothesis, const lm::ngram::Right &state, uint64_t features) {
+  std::size_t source_index = hypothesis.SourceEndIndex();
+  return util::MurmurHashNative(&source_index, sizeof(std::size_t),
+      hash_value(state, hash_value(hypothesis.GetCoverage()) ^ features));
+}
+} // namespace
   
 Hypothesis *HypothesisBuilder::BuildHypothesis(
     const lm::ngram::Right &state, float score, const pt::Row *target) {
@@ -9,6 +20,7 @@ Hypothesis *HypothesisBuilder::BuildHypothesis(
   void *hypo = feature_init_.hypothesis_layout.Allocate(pool_);
   feature_init_.hypothesis_field(hypo) = Hypothesis(score, target_phrase);
   feature_init_.lm_state_field(hypo) = state;
+  feature_init_.recombination_field(hypo) = RecombinationHash(feature_init_.hypothesis_field(hypo), state, 0);
   return reinterpret_cast<Hypothesis*>(hypo);
 }
 
@@ -22,12 +34,15 @@ Hypothesis *HypothesisBuilder::BuildHypothesis(
     const TargetPhrase *target) {
   feature_init_.hypothesis_field(base) = Hypothesis(score, previous, source_begin, source_end, target);
   feature_init_.lm_state_field(base) = state;
+  uint64_t &hash = feature_init_.recombination_field(base);
+  hash = RecombinationHash(*base, state, hash);
   return base;
 }
 
 Hypothesis *HypothesisBuilder::NextHypothesis(const Hypothesis *previous_hypothesis) {
   void *hypo = feature_init_.hypothesis_layout.Allocate(pool_);
   feature_init_.hypothesis_field(hypo) = Hypothesis(previous_hypothesis);
+  feature_init_.recombination_field(hypo) = 0;
   return reinterpret_cast<Hypothesis*>(hypo);
 }
 
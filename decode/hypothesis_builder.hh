@@ -21,7 +21,8 @@ class HypothesisBuilder {
         float score,
         const pt::Row *target);
 
-    /** Initializes an instance of Hypothesis on the layout at *base */
+    /** Initializes an instance of Hypothesis on the layout at *base and
+     * completes its recombination hash */
     Hypothesis *BuildHypothesis(
         Hypothesis *base,
         const lm::ngram::Right &state,
@@ -32,7 +33,7 @@ class HypothesisBuilder {
         const TargetPhrase *target);
 
     /** Allocates an incomplete hypothesis, consisting only of a
-     * back-reference */
+     * back-reference and an empty recombination hash */
     Hypothesis *NextHypothesis(const Hypothesis *previous_hypothesis);
 
     /** Allocates a copy of the fixed-size part of hypothesis */
@@ -0,0 +1,70 @@
+#include "decode/lattice.hh"
+
+#include "decode/feature_init.hh"
+#include "decode/hypothesis.hh"
+#include "decode/stacks.hh"
+#include "decode/vocab_map.hh"
+#include "util/string_stream.hh"
+
+#include <boost/unordered_map.hpp>
+
+namespace decode {
+
+void OutputLattice(uint64_t sentence, const Stacks &stacks, const VocabMap &vocab,
+    const FeatureInit &feature_init, util::StringStream &out) {
+  out << sentence << '\n';
+  const std::vector<Stack> &all = stacks.AllStacks();
+  if (!stacks.End()) {
+    out << '\n';
+    return;
+  }
+  // Find recombination winners that lead to the end, walking back from it.
+  typedef boost::unordered_map<const Hypothesis*, std::size_t> States;
+  States states;
+  states[stacks.End()] = 0;
+  for (std::vector<Stack>::const_reverse_iterator stack = all.rbegin(); stack != all.rend(); ++stack) {
+    for (const Hypothesis *winner : *stack) {
+      if (!states.count(winner)) continue;
+      for (const Hypothesis *h = winner; h; h = h->Recombined()) {
+        if (h->Previous()) states[h->Previous()] = 0;
+      }
+    }
+  }
+  // Number them forward so the root is the start state.  Words after the
+  // first in a phrase get states after those.
+  std::size_t next_state = 0, next_internal = states.size();
+  for (const Stack &stack : all) {
+    const bool last = (&stack == &all.back());
+    for (const Hypothesis *winner : stack) {
+      States::iterator to = states.find(winner);
+      if (to == states.end()) continue;
+      to->second = next_state++;
+      for (const Hypothesis *h = winner; h; h = h->Recombined()) {
+        const Hypothesis *previous = h->Previous();
+        if (!previous) continue;
+        std::size_t from = states.find(previous)->second;
+        // The root's score is the future cost estimate for the whole sentence
+        // which the estimates in later hypotheses cancel, so leave it out.
+        float cost = (previous->Previous() ? previous->GetScore() : 0.0) - h->GetScore();
+        if (last) {
+          out << from << ' ' << to->second << " <eps> " << cost << '\n';
+          continue;
+        }
+        auto ids = feature_init.phrase_access.target(feature_init.pt_row_field(h->Target()));
+        if (ids.empty()) {
+          out << from << ' ' << to->second << " <eps> " << cost << '\n';
+          continue;
+        }
+        for (std::size_t i = 0; i < ids.size(); ++i) {
+          std::size_t next = (i + 1 == ids.size()) ? to->second : next_internal++;
+          out << from << ' ' << next << ' ' << vocab.String(ids[i]) << ' ' << cost << '\n';
+          from = next;
+          cost = 0.0;
+        }
+      }
+    }
+  }
+  out << states.find(stacks.End())->second << "\n\n";
+}
+
+} // namespace decode
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace util { class StringStream; }
+
+namespace decode {
+
+class Stacks;
+class VocabMap;
+struct FeatureInit;
+
+/* Write the search graph in OpenFST text format, preceded by a line with the
+ * sentence number and followed by a blank line like a Kaldi text archive.
+ * States are recombined hypotheses; every hypothesis, including those that
+ * lost recombination, is a path of arcs labeled with its target words.
+ * Weights are costs (negated scores) and sum to the derivation's score along
+ * any path.  Hypotheses that cannot reach the end of sentence are left out.
+ *
+ * The graph is read straight from the hypotheses, so stacks must outlive
+ * this call.
+ */
+void OutputLattice(uint64_t sentence, const Stacks &stacks, const VocabMap &vocab,
+    const FeatureInit &feature_init, util::StringStream &out);
+
+} // namespace decode
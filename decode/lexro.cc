@@ -1,5 +1,6 @@
 #include "decode/lexro.hh"
 #include "util/exception.hh"
+#include "util/murmur_hash.hh"
 
 namespace decode {
 
@@ -23,6 +24,7 @@ void LexicalizedReordering::ScoreHypothesisWithSourcePhrase(
   if (source_phrase.Length() == 0) { return; }
   // store phrase start index in layout; phrase end is already stored in the hypothesis
   phrase_start_(collector.NewHypothesis()) = source_phrase.Span().first;
+  collector.AddRecombinationKey(source_phrase.Span().first);
   // score backward lexro
   SourceSpan hypo_span;
   if (hypothesis.Previous()) {
@@ -37,11 +39,19 @@ void LexicalizedReordering::ScoreHypothesisWithSourcePhrase(
 
 void LexicalizedReordering::ScoreHypothesisWithPhrasePair(
     const Hypothesis &hypothesis, PhrasePair phrase_pair, ScoreCollector &collector) const {
-  SourceSpan hypo_span(phrase_start_(&hypothesis), hypothesis.SourceEndIndex());
+  SourceSpan hypo_span;
+  if (hypothesis.Previous()) {
+    hypo_span = SourceSpan(phrase_start_(&hypothesis), hypothesis.SourceEndIndex());
+  } else { // start of sentence: phrase_start_ is not set
+    hypo_span = SourceSpan(0,0);
+  }
   uint8_t index = FORWARD + PhraseRelation(hypo_span, phrase_pair.source.Span());
   const pt::Row *target = pt_row_(phrase_pair.target);
   float score = phrase_access_->lexical_reordering(target)[index];
   collector.AddDense(index, score);
+  // The backward scores of this phrase are used by the next extension.
+  const float *backward = phrase_access_->lexical_reordering(target).begin() + BACKWARD;
+  collector.AddRecombinationKey(util::MurmurHashNative(backward, (VALUE_COUNT - BACKWARD) * sizeof(float)));
 }
 
 bool LexicalizedReordering::HypothesisEqual(
@@ -19,6 +19,10 @@ class LexicalizedReordering : public Feature {
 
     LexicalizedReordering() : Feature("lexical_reordering") {}
 
+    ScoreMethods UsedScoreMethods() const override {
+      return kScoreHypothesisWithSourcePhrase | kScoreHypothesisWithPhrasePair | kHypothesisEqual;
+    }
+
     void Init(FeatureInit &feature_init) override;
 
     void NewWord(const StringPiece string_rep, VocabWord *word) const override {}
@@ -49,10 +49,12 @@ BOOST_AUTO_TEST_CASE(LexRo) {
   util::Layout fstore_layout;
   util::ArrayField<float> fstore(fstore_layout, 6);
   FeatureStore store(fstore, fstore_layout.Allocate(pool));
+  store.Init();
   std::vector<VocabWord*> sentence;
   for (int i=0; i<6; ++i) sentence.push_back(nullptr);
   SourcePhrase source_phrase(sentence, 5,6);
-  ScoreCollector collector(weights, next, nullptr, store);
+  init.recombination_field(next) = 0;
+  ScoreCollector collector(weights, next, nullptr, store, init.recombination_field);
   collector.SetDenseOffset(0);
 
   // monotone source, forward scoring
@@ -64,17 +66,34 @@ BOOST_AUTO_TEST_CASE(LexRo) {
   BOOST_CHECK_EQUAL(14+3, collector.Score());
   BOOST_CHECK_EQUAL(3, store()[0]);
   BOOST_CHECK_EQUAL(14, store()[3]);
+  const uint64_t next_key = init.recombination_field(next);
+  BOOST_CHECK(next_key);
 
   // for next source phrase we can use backwards reordering score
   SourcePhrase swap_source(sentence,1,5);
   FeatureStore store2(fstore, fstore_layout.Allocate(pool));
-  ScoreCollector collector2(weights, snd_next, nullptr, store2);
+  store2.Init();
+  init.recombination_field(snd_next) = 0;
+  ScoreCollector collector2(weights, snd_next, nullptr, store2, init.recombination_field);
   collector2.SetDenseOffset(0);
   lexro.ScoreHypothesisWithSourcePhrase(*next, swap_source, collector2);
   BOOST_CHECK_EQUAL(15, collector2.Score());
   BOOST_CHECK_SMALL(store2()[1], 0.000001f);
   BOOST_CHECK_EQUAL(15, store2()[4]);
 
+  // The key depends on the phrase start and the backward scores.
+  Hypothesis *other = reinterpret_cast<Hypothesis*>(init.hypothesis_layout.Allocate(pool));
+  init.recombination_field(other) = 0;
+  ScoreCollector collector3(weights, other, nullptr, store2, init.recombination_field);
+  collector3.SetDenseOffset(0);
+  lexro.ScoreHypothesisWithSourcePhrase(*hypo, source_phrase, collector3);
+  lexro.ScoreHypothesisWithPhrasePair(*hypo, PhrasePair(source_phrase, row2), collector3);
+  BOOST_CHECK_EQUAL(next_key, init.recombination_field(other));
+  init.recombination_field(other) = 0;
+  lexro.ScoreHypothesisWithSourcePhrase(*hypo, source_phrase, collector3);
+  lexro.ScoreHypothesisWithPhrasePair(*hypo, PhrasePair(source_phrase, row1), collector3);
+  BOOST_CHECK(next_key != init.recombination_field(other));
+
   // TODO test no score on addition of zero-length source phrase (eos)
 }
 
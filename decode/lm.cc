@@ -2,13 +2,58 @@
 
 #include "decode/vocab_map.hh"
 #include "lm/left.hh"
+#include "pt/access.hh"
+#include "util/file.hh"
+#include "util/murmur_hash.hh"
 #include "util/mutable_vocab.hh"
 #include "util/exception.hh"
 
+#include <cstring>
+
 namespace decode {
 
-LM::LM(const char *model) :
-  Feature("lm"), model_(model) {}
+namespace {
+lm::ngram::Config LoadConfig(util::LoadMethod load_method) {
+  lm::ngram::Config ret;
+  ret.load_method = load_method;
+  return ret;
+}
+
+// Hash the whole file, so any rebuilt model, even one of the same size, has
+// another checksum.
+uint64_t FileChecksum(const char *file) {
+  const std::size_t kBlockSize = 1 << 20;
+  util::scoped_fd fd(util::OpenReadOrThrow(file));
+  uint64_t ret = 0;
+  std::vector<char> block(kBlockSize);
+  std::size_t got;
+  while ((got = util::ReadOrEOF(fd.get(), block.data(), kBlockSize))) {
+    ret = util::MurmurHash64A(block.data(), got, ret);
+  }
+  return ret;
+}
+
+template <class T> void Append(const T *from, std::size_t count, std::vector<uint8_t> &to) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(from);
+  to.insert(to.end(), bytes, bytes + count * sizeof(T));
+}
+
+template <class T> const uint8_t *Read(const uint8_t *from, std::size_t count, T *to) {
+  std::memcpy(to, from, count * sizeof(T));
+  return from + count * sizeof(T);
+}
+} // namespace
+
+LM::LM(const char *model, util::LoadMethod load_method) :
+  Feature("lm"), model_(model, LoadConfig(load_method)), file_(model) {}
+
+uint64_t LM::Checksum() const {
+  if (!checksum_known_) {
+    checksum_ = FileChecksum(file_.c_str());
+    checksum_known_ = true;
+  }
+  return checksum_;
+}
 
 void LM::Init(FeatureInit &feature_init) {
   pt_row_field_ = feature_init.pt_row_field;
@@ -29,14 +74,54 @@ void LM::ScoreTargetPhrase(TargetPhraseInfo target, ScoreCollector &collector) c
 }
 
 void LM::InitTargetPhrase(TargetPhraseInfo target, lm::ngram::ChartState &state) const {
-  lm::ngram::RuleScore<lm::ngram::Model> scorer(model_, state);
   const pt::Row *pt_target_phrase = pt_row_field_(target.phrase);
+  if (table_state_ && target.type == TargetPhraseType::Table) {
+    phrase_score_field_(target.phrase) = LoadState(phrase_access_->lm_state(pt_target_phrase).begin(), state);
+    return;
+  }
+  lm::ngram::RuleScore<lm::ngram::Model> scorer(model_, state);
   for (const ID i : phrase_access_->target(pt_target_phrase)) {
     scorer.Terminal(lm_word_index_(target.vocab_map.Find(i)));
   }
   phrase_score_field_(target.phrase) = scorer.Finish();
 }
 
+float LM::ScorePhrase(const lm::WordIndex *begin, const lm::WordIndex *end, lm::ngram::ChartState &state) const {
+  lm::ngram::RuleScore<lm::ngram::Model> scorer(model_, state);
+  for (const lm::WordIndex *i = begin; i != end; ++i) {
+    scorer.Terminal(*i);
+  }
+  return scorer.Finish();
+}
+
+bool LM::UseTableState(const pt::FieldConfig &config) {
+  // Only read the whole model when the table has state to check.
+  table_state_ = config.lm_state && config.lm_checksum == Checksum();
+  return table_state_;
+}
+
+void LM::SaveState(float score, const lm::ngram::ChartState &state, std::vector<uint8_t> &to) {
+  Append(&score, 1, to);
+  Append(&state.left.length, 1, to);
+  Append(&state.left.full, 1, to);
+  Append(&state.right.length, 1, to);
+  Append(state.left.pointers, state.left.length, to);
+  Append(state.right.words, state.right.length, to);
+  Append(state.right.backoff, state.right.length, to);
+}
+
+float LM::LoadState(const uint8_t *from, lm::ngram::ChartState &state) {
+  float score;
+  from = Read(from, 1, &score);
+  from = Read(from, 1, &state.left.length);
+  from = Read(from, 1, &state.left.full);
+  from = Read(from, 1, &state.right.length);
+  from = Read(from, state.left.length, state.left.pointers);
+  from = Read(from, state.right.length, state.right.words);
+  Read(from, state.right.length, state.right.backoff);
+  return score;
+}
+
 void LM::SetSearchScore(Hypothesis *new_hypothesis, float score) const {
   hypothesis_with_phrase_pair_score_(new_hypothesis) = score;
 }
@@ -5,13 +5,22 @@
 #include "lm/state.hh"
 #include "util/layout.hh"
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pt { class FieldConfig; }
 namespace util { class MutableVocab; }
 
 namespace decode {
 
 class LM : public Feature, public ObjectiveBypass {
   public:
-    LM(const char *model);
+    explicit LM(const char *model, util::LoadMethod load_method = util::POPULATE_OR_READ);
+
+    ScoreMethods UsedScoreMethods() const override {
+      return kScoreTargetPhrase | kScoreHypothesisWithPhrasePair;
+    }
 
     void Init(FeatureInit &feature_init) override;
 
@@ -46,8 +55,31 @@ class LM : public Feature, public ObjectiveBypass {
 
     const lm::ngram::Model &Model() const { return model_; }
 
+    // Identifies the model file for state stored in phrase tables and baked
+    // vocabularies.  The first call reads the whole file.
+    uint64_t Checksum() const;
+
+    // Score words as a phrase on their own, which is what InitTargetPhrase
+    // does with each target phrase.
+    float ScorePhrase(const lm::WordIndex *begin, const lm::WordIndex *end, lm::ngram::ChartState &state) const;
+
+    /* Use the state that pt::AddLMStates stored in the table's rows instead
+     * of scoring them, if this model made it.  Returns whether it did.  Call
+     * after Init.
+     */
+    bool UseTableState(const pt::FieldConfig &config);
+
+    // The row format of stored state.  Only the used part of state is kept.
+    static void SaveState(float score, const lm::ngram::ChartState &state, std::vector<uint8_t> &to);
+    static float LoadState(const uint8_t *from, lm::ngram::ChartState &state);
+
   private:
     lm::ngram::Model model_;
+    const std::string file_;
+    // Checksum of file_, once known.
+    mutable uint64_t checksum_ = 0;
+    mutable bool checksum_known_ = false;
+    bool table_state_ = false;
     const pt::Access *phrase_access_;
     util::PODField<const pt::Row*> pt_row_field_;
     util::PODField<lm::WordIndex> lm_word_index_;
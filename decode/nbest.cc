@@ -0,0 +1,100 @@
+#include "decode/nbest.hh"
+
+#include "decode/hypothesis.hh"
+
+#include <boost/unordered_map.hpp>
+
+#include <algorithm>
+#include <queue>
+
+namespace decode {
+
+namespace {
+
+// Hypotheses that recombined together, best first.
+typedef std::vector<const Hypothesis*> Alternatives;
+
+class AlternativeCache {
+  public:
+    // winner is the hypothesis the others recombined into.
+    const Alternatives &Get(const Hypothesis *winner) {
+      Alternatives &alternatives = map_[winner];
+      if (alternatives.empty()) {
+        for (const Hypothesis *h = winner; h; h = h->Recombined()) {
+          alternatives.push_back(h);
+        }
+        // The winner stays in front even if tied.
+        std::stable_sort(alternatives.begin() + 1, alternatives.end(),
+            [](const Hypothesis *a, const Hypothesis *b) { return a->GetScore() > b->GetScore(); });
+      }
+      return alternatives;
+    }
+
+  private:
+    boost::unordered_map<const Hypothesis*, Alternatives> map_;
+};
+
+struct Candidate {
+  Derivation derivation;
+  // The last swap: alternatives[rank] was placed at path[position].  NULL
+  // alternatives for the best derivation, which has no swaps.
+  const Alternatives *alternatives;
+  std::size_t position;
+  std::size_t rank;
+
+  bool operator<(const Candidate &other) const {
+    return derivation.score < other.derivation.score;
+  }
+};
+
+Candidate Swap(const Candidate &parent, std::size_t position, const Alternatives &alternatives, std::size_t rank) {
+  const std::vector<const Hypothesis*> &from = parent.derivation.path;
+  Candidate ret;
+  ret.derivation.score = parent.derivation.score - from[position]->GetScore() + alternatives[rank]->GetScore();
+  ret.derivation.path.assign(from.begin(), from.begin() + position);
+  for (const Hypothesis *h = alternatives[rank]; h; h = h->Previous()) {
+    ret.derivation.path.push_back(h);
+  }
+  ret.alternatives = &alternatives;
+  ret.position = position;
+  ret.rank = rank;
+  return ret;
+}
+
+} // namespace
+
+void NBest(const Hypothesis &best, std::size_t size, std::vector<Derivation> &out) {
+  out.clear();
+  AlternativeCache cache;
+  std::priority_queue<Candidate> queue;
+  Candidate initial;
+  initial.derivation.score = best.GetScore();
+  for (const Hypothesis *h = &best; h; h = h->Previous()) {
+    initial.derivation.path.push_back(h);
+  }
+  initial.alternatives = NULL;
+  initial.position = 0;
+  initial.rank = 0;
+  queue.push(initial);
+  while (!queue.empty() && out.size() < size) {
+    Candidate top(queue.top());
+    queue.pop();
+    std::size_t first_swap = 0;
+    if (top.alternatives) {
+      // Next alternative in the same place.
+      if (top.rank + 1 < top.alternatives->size()) {
+        queue.push(Swap(top, top.position, *top.alternatives, top.rank + 1));
+      }
+      first_swap = top.position + 1;
+    }
+    // Everything after the last swap is a winner of recombination.
+    for (std::size_t position = first_swap; position < top.derivation.path.size(); ++position) {
+      const Hypothesis *winner = top.derivation.path[position];
+      if (!winner->Recombined()) continue;
+      queue.push(Swap(top, position, cache.Get(winner), 1));
+    }
+    out.push_back(std::move(top.derivation));
+  }
+}
+
+} // namespace decode
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace decode {
+
+class Hypothesis;
+
+// A complete translation.  path runs from the final hypothesis back to the
+// root hypothesis, so path.front() is the end of sentence.
+struct Derivation {
+  float score;
+  std::vector<const Hypothesis*> path;
+};
+
+/* Extract up to size best derivations, best first, from the recombination
+ * alternatives kept in each Hypothesis (see Hypothesis::Recombined).  best is
+ * the final hypothesis returned by Stacks::End.
+ *
+ * Alternatives that recombined share their future, so swapping one for
+ * another changes the score by the difference in their scores.  Each
+ * derivation differs from its parent by one such swap and swaps only
+ * happen after the parent's last swap, so derivations are found lazily in
+ * order without duplicates.
+ */
+void NBest(const Hypothesis &best, std::size_t size, std::vector<Derivation> &out);
+
+} // namespace decode
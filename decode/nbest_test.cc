@@ -0,0 +1,137 @@
+#include "decode/nbest.hh"
+
+#include "decode/hypothesis.hh"
+#include "decode/test_util.hh"
+#include "util/tokenize_piece.hh"
+
+#define BOOST_TEST_MODULE NBestTest
+#include <boost/test/unit_test.hpp>
+
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace decode {
+namespace {
+
+// Scores of the derivations, best first.
+std::vector<float> Scores(const std::vector<Derivation> &derivations) {
+  std::vector<float> ret;
+  for (const Derivation &d : derivations) ret.push_back(d.score);
+  return ret;
+}
+
+BOOST_AUTO_TEST_CASE(Lattice) {
+  Hypothesis root(0.0, NULL);
+  // Two ways to cover the first word, recombined.
+  Hypothesis a(-1.0, &root, 0, 1, NULL);
+  Hypothesis b(-3.0, &root, 0, 1, NULL);
+  a.AddRecombined(&b);
+  // Three final hypotheses extending a.
+  Hypothesis end(-2.0, &a, 1, 1, NULL);
+  Hypothesis end2(-2.5, &a, 1, 1, NULL);
+  Hypothesis end3(-6.0, &a, 1, 1, NULL);
+  end.AddRecombined(&end3);
+  end.AddRecombined(&end2);
+
+  std::vector<Derivation> out;
+  NBest(end, 10, out);
+  // Finals -2, -2.5, -6, each with a (0) or b (-2).
+  float expected[] = {-2.0, -2.5, -4.0, -4.5, -6.0, -8.0};
+  std::vector<float> scores(Scores(out));
+  BOOST_CHECK_EQUAL_COLLECTIONS(expected, expected + 6, scores.begin(), scores.end());
+
+  BOOST_REQUIRE_EQUAL(3, out[2].path.size());
+  BOOST_CHECK_EQUAL(&end, out[2].path[0]);
+  BOOST_CHECK_EQUAL(&b, out[2].path[1]);
+  BOOST_CHECK_EQUAL(&root, out[2].path[2]);
+  BOOST_CHECK_EQUAL(&end2, out[3].path[0]);
+  BOOST_CHECK_EQUAL(&b, out[3].path[1]);
+
+  NBest(end, 3, out);
+  BOOST_CHECK_EQUAL(3, out.size());
+}
+
+BOOST_AUTO_TEST_CASE(Single) {
+  Hypothesis root(0.0, NULL);
+  Hypothesis end(-1.0, &root, 0, 0, NULL);
+  std::vector<Derivation> out;
+  NBest(end, 5, out);
+  BOOST_REQUIRE_EQUAL(1, out.size());
+  BOOST_CHECK_EQUAL(2, out[0].path.size());
+}
+
+struct Arc {
+  std::size_t from, to;
+  std::string label;
+  float cost;
+};
+
+BOOST_AUTO_TEST_CASE(OutputLatticeTwoWords) {
+  // A and A2 have different language model states, so they do not
+  // recombine, but A B and A2 B do.  Monotone, so the lattice only has the
+  // paths A|A2 then B|B2.
+  test::TinyDecoder decoder("B");
+  OutputOptions options;
+  options.lattice = true;
+  Translation translation;
+  translation.sequence = 7;
+  decoder.Decode("a b", options, translation);
+  const Hypothesis *end = decoder.GetStacks().End();
+  BOOST_REQUIRE(end);
+
+  std::string lattice(translation.lattice.str());
+  util::TokenIter<util::SingleCharacter> line(lattice, '\n');
+  BOOST_REQUIRE(line);
+  BOOST_CHECK_EQUAL("7", *line);
+  std::vector<Arc> arcs;
+  std::size_t final_state = 0;
+  for (++line; line && !line->empty(); ++line) {
+    std::vector<std::string> fields;
+    for (util::TokenIter<util::SingleCharacter> field(*line, ' '); field; ++field) {
+      fields.push_back(field->as_string());
+    }
+    if (fields.size() == 1) {
+      final_state = std::stoul(fields[0]);
+      continue;
+    }
+    BOOST_REQUIRE_EQUAL(4, fields.size());
+    Arc arc = {std::stoul(fields[0]), std::stoul(fields[1]), fields[2], std::stof(fields[3])};
+    arcs.push_back(arc);
+  }
+
+  // A and A2 from the start, B and B2 after each, then </s> after B and B2.
+  std::map<std::string, std::vector<Arc> > by_label;
+  for (const Arc &arc : arcs) by_label[arc.label].push_back(arc);
+  BOOST_CHECK_EQUAL(8, arcs.size());
+  BOOST_REQUIRE_EQUAL(1, by_label["A"].size());
+  BOOST_REQUIRE_EQUAL(1, by_label["A2"].size());
+  BOOST_CHECK_EQUAL(0, by_label["A"][0].from);
+  BOOST_CHECK_EQUAL(0, by_label["A2"][0].from);
+  BOOST_CHECK(by_label["A"][0].to != by_label["A2"][0].to);
+  // A B and A2 B recombined, so the loser is an extra arc into the same state.
+  for (const char *label : {"B", "B2"}) {
+    const std::vector<Arc> &into = by_label[label];
+    BOOST_REQUIRE_EQUAL(2, into.size());
+    BOOST_CHECK_EQUAL(into[0].to, into[1].to);
+    BOOST_CHECK(into[0].from != into[1].from);
+  }
+  BOOST_CHECK_EQUAL(2, by_label["<eps>"].size());
+
+  // Costs along the best path sum to the negated score.  Relax every arc
+  // once per arc, which is enough for an acyclic graph this small.
+  std::vector<float> best(arcs.size() + 1, std::numeric_limits<float>::infinity());
+  best[0] = 0.0;
+  for (std::size_t round = 0; round < arcs.size(); ++round) {
+    for (const Arc &arc : arcs) {
+      BOOST_REQUIRE(arc.to < best.size());
+      best[arc.to] = std::min(best[arc.to], best[arc.from] + arc.cost);
+    }
+  }
+  BOOST_REQUIRE(final_state < best.size());
+  BOOST_CHECK_CLOSE(-end->GetScore(), best[final_state], 0.001);
+}
+
+} // namespace
+} // namespace decode
@@ -12,7 +12,14 @@ Objective::Objective(
 
 void Objective::AddFeature(Feature &feature) {
   feature.Init(feature_init_);
-  features_.push_back(FeatureInfo{&feature,dense_feature_count_});
+  const FeatureInfo info{&feature, dense_feature_count_};
+  features_.push_back(info);
+  const ScoreMethods methods = dispatch_all_ ? kAllScoreMethods : feature.UsedScoreMethods();
+  if (methods & kScoreTargetPhrase) target_phrase_features_.push_back(info);
+  if (methods & kScoreHypothesisWithSourcePhrase) source_phrase_features_.push_back(info);
+  if (methods & kScoreHypothesisWithPhrasePair) phrase_pair_features_.push_back(info);
+  if (methods & kScoreFinalHypothesis) final_features_.push_back(info);
+  if (methods & kHypothesisEqual) equal_features_.push_back(info);
   dense_feature_count_ += feature.DenseFeatureCount();
   weights.resize(dense_feature_count_, 1);
 }
@@ -56,11 +63,20 @@ void Objective::InitPassthroughPhrase(pt::Row *passthrough, TargetPhraseType typ
 }
 
 float Objective::ScoreTargetPhrase(TargetPhraseInfo target) const {
+  return ScoreTargetPhrase(target, nullptr);
+}
+
+float Objective::ScoreTargetPhraseWithoutLM(TargetPhraseInfo target) const {
+  return ScoreTargetPhrase(target, lm_as_feature_);
+}
+
+float Objective::ScoreTargetPhrase(TargetPhraseInfo target, const Feature *skip) const {
   Hypothesis *null_hypo = nullptr;
   FeatureStore store(phrase_feature_values_, store_feature_values_ ? target.phrase : nullptr);
   store.Init();
   auto collector = GetCollector(null_hypo, nullptr, store);
-  for (auto feature : features_) {
+  for (const FeatureInfo &feature : target_phrase_features_) {
+    if (feature.feature == skip) continue;
     collector.SetDenseOffset(feature.offset);
     feature.feature->ScoreTargetPhrase(target, collector);
   }
@@ -73,7 +89,7 @@ float Objective::ScoreHypothesisWithSourcePhrase(
   FeatureStore store(hypothesis_feature_values_, store_feature_values_ ? new_hypothesis : nullptr);
   store.Init();
   auto collector = GetCollector(new_hypothesis, nullptr, store);
-  for (auto feature : features_) {
+  for (const FeatureInfo &feature : source_phrase_features_) {
     collector.SetDenseOffset(feature.offset);
     feature.feature->ScoreHypothesisWithSourcePhrase(hypothesis, source_phrase, collector);
   }
@@ -90,7 +106,7 @@ float Objective::ScoreHypothesisWithPhrasePair(
     }
   }
   auto collector = GetCollector(new_hypothesis, &hypothesis_pool, store);
-  for (auto feature : features_) {
+  for (const FeatureInfo &feature : phrase_pair_features_) {
     collector.SetDenseOffset(feature.offset);
     feature.feature->ScoreHypothesisWithPhrasePair(hypothesis, phrase_pair, collector);
   }
@@ -101,7 +117,7 @@ float Objective::ScoreFinalHypothesis(Hypothesis &hypothesis) const {
   Hypothesis *null_hypo = nullptr;
   FeatureStore store(hypothesis_feature_values_, store_feature_values_ ? &hypothesis : nullptr);
   auto collector = GetCollector(null_hypo, nullptr, store);
-  for (auto feature : features_) {
+  for (const FeatureInfo &feature : final_features_) {
     collector.SetDenseOffset(feature.offset);
     feature.feature->ScoreFinalHypothesis(hypothesis, collector);
   }
@@ -109,7 +125,7 @@ float Objective::ScoreFinalHypothesis(Hypothesis &hypothesis) const {
 }
 
 bool Objective::HypothesisEqual(const Hypothesis &first, const Hypothesis &second) const {
-  for (auto feature : features_) {
+  for (const FeatureInfo &feature : equal_features_) {
     if (!feature.feature->HypothesisEqual(first, second)) { return false; }
   }
   return true;
@@ -129,11 +145,21 @@ std::string Objective::FeatureDescription(std::size_t index) const {
   }
 }
 
+StringPiece Objective::FeatureName(std::size_t index) const {
+  assert(index < dense_feature_count_);
+  for (auto feature : features_) {
+    if (index - feature.offset < feature.feature->DenseFeatureCount()) {
+      return feature.feature->name;
+    }
+  }
+  return StringPiece();
+}
+
 ScoreCollector Objective::GetCollector(
     Hypothesis *&new_hypothesis,
     util::Pool *hypothesis_pool,
     FeatureStore feature_store) const {
-  return ScoreCollector(weights, new_hypothesis, hypothesis_pool, feature_store);
+  return ScoreCollector(weights, new_hypothesis, hypothesis_pool, feature_store, feature_init_.recombination_field);
 }
 
 } // namespace decode
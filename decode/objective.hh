@@ -20,6 +20,12 @@ class Objective {
 
     void AddFeature(Feature &feature);
 
+    // Call every hook of every feature, ignoring Feature::UsedScoreMethods.
+    // Only for measuring the difference.  Call before AddFeature.
+    void SetDispatchAll(bool all) {
+      dispatch_all_ = all;
+    }
+
     void SetStoreFeatureValues(bool store) {
       store_feature_values_ = store;
     }
@@ -28,6 +34,7 @@ class Objective {
 
     void RegisterLanguageModel(ObjectiveBypass &lm_feature) {
       lm_feature_ = &lm_feature;
+      lm_as_feature_ = dynamic_cast<const Feature*>(&lm_feature);
     }
 
     const ObjectiveBypass *GetLanguageModelFeature() const {
@@ -46,6 +53,11 @@ class Objective {
 
     float ScoreTargetPhrase(TargetPhraseInfo target) const;
 
+    // ScoreTargetPhrase without the language model.  Its phrase scores are
+    // log probabilities, so with a positive weight this is an upper bound
+    // that does not need the phrase to be scored by the language model.
+    float ScoreTargetPhraseWithoutLM(TargetPhraseInfo target) const;
+
     float ScoreHypothesisWithSourcePhrase(
         const Hypothesis &hypothesis, const SourcePhrase source_phrase,
         Hypothesis *&new_hypothesis) const;
@@ -62,6 +74,9 @@ class Objective {
 
     std::string FeatureDescription(std::size_t index) const;
 
+    // Name of the feature, as in the weights file, owning a dense index.
+    StringPiece FeatureName(std::size_t index) const;
+
     const lm::ngram::State &BeginSentenceState() const {
       return lm_begin_sentence_state_;
     }
@@ -77,8 +92,17 @@ class Objective {
         util::Pool *hypothesis_pool,
         FeatureStore feature_store) const;
 
-    // TODO use ScoreMethod values to make list of features for each method
+    // Skips the feature skip, which may be nullptr.
+    float ScoreTargetPhrase(TargetPhraseInfo target, const Feature *skip) const;
+
     std::vector<FeatureInfo> features_;
+    // Features that use each scoring hook.
+    std::vector<FeatureInfo> target_phrase_features_;
+    std::vector<FeatureInfo> source_phrase_features_;
+    std::vector<FeatureInfo> phrase_pair_features_;
+    std::vector<FeatureInfo> final_features_;
+    std::vector<FeatureInfo> equal_features_;
+    bool dispatch_all_ = false;
     std::size_t dense_feature_count_ = 0;
 
     bool store_feature_values_;
@@ -87,6 +111,8 @@ class Objective {
 
     FeatureInit feature_init_;
     const ObjectiveBypass *lm_feature_ = nullptr;
+    // The same object as a Feature, if it is one.
+    const Feature *lm_as_feature_ = nullptr;
 
     const lm::ngram::State lm_begin_sentence_state_;
 };
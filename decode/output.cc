@@ -2,13 +2,15 @@
 
 #include "decode/vocab_map.hh"
 #include "decode/feature_init.hh"
-#include "util/file_stream.hh"
+#include "decode/nbest.hh"
+#include "decode/objective.hh"
+#include "util/string_stream.hh"
 
 #include <string.h>
 
 namespace decode {
 
-void PrintOptionalInfo(ScoreHistoryMap &map, float score_delta, util::FileStream &out) {
+void PrintOptionalInfo(ScoreHistoryMap &map, float score_delta, util::StringStream &out) {
   map["_total"].scores.push_back(score_delta);
   map["_total"].total += score_delta;
 
@@ -24,8 +26,16 @@ void PrintOptionalInfo(ScoreHistoryMap &map, float score_delta, util::FileStream
   }
 }
 
+void OutputTarget(const Hypothesis &hypo, const VocabMap &vocab,
+    const FeatureInit &feature_init, util::StringStream &out) {
+  auto ids = feature_init.phrase_access.target(feature_init.pt_row_field(hypo.Target()));
+  for (const ID id : ids) {
+    out << ' ' << vocab.String(id);
+  }
+}
+
 void Output(const Hypothesis &hypo, const VocabMap &vocab,
-    ScoreHistoryMap &map, util::FileStream &out, const FeatureInit &feature_init,
+    ScoreHistoryMap &map, util::StringStream &out, const FeatureInit &feature_init,
     bool verbose) {
   std::vector<const Hypothesis*> hypos;
   for (const Hypothesis *h = &hypo; h; h = h->Previous()) {
@@ -36,10 +46,7 @@ void Output(const Hypothesis &hypo, const VocabMap &vocab,
   float previous_score = 0.0;
   assert(feature_init.phrase_access.target);
   for (std::vector<const Hypothesis*>::const_reverse_iterator i = hypos.rbegin(); i != hypos.rend()-1/*ignore EOS*/; ++i) {
-    auto ids = feature_init.phrase_access.target(feature_init.pt_row_field((*i)->Target()));
-    for (const ID id : ids) {
-      out << ' ' << vocab.String(id);
-    }
+    OutputTarget(**i, vocab, feature_init, out);
     if (verbose) {
       float this_score = hypo.GetScore();
       float score_delta = this_score - previous_score;
@@ -50,4 +57,33 @@ void Output(const Hypothesis &hypo, const VocabMap &vocab,
   }
 }
 
+void OutputNBest(uint64_t sentence, const std::vector<Derivation> &derivations,
+    const VocabMap &vocab, Objective &objective, util::StringStream &out) {
+  const FeatureInit &feature_init = objective.GetFeatureInit();
+  std::vector<float> feature_values;
+  for (const Derivation &derivation : derivations) {
+    out << sentence << " |||";
+    // Root to the hypothesis before end of sentence.
+    for (std::vector<const Hypothesis*>::const_reverse_iterator i = derivation.path.rbegin(); i != derivation.path.rend() - 1; ++i) {
+      OutputTarget(**i, vocab, feature_init, out);
+    }
+    out << " |||";
+    feature_values.assign(objective.DenseFeatureCount(), 0.0);
+    for (const Hypothesis *hyp : derivation.path) {
+      if (!hyp->Previous()) break;
+      std::size_t i = 0;
+      for (float v : objective.GetFeatureValues(*hyp)) {
+        feature_values[i++] += v;
+      }
+    }
+    for (std::size_t i = 0; i < feature_values.size(); ++i) {
+      if (i == 0 || objective.FeatureName(i) != objective.FeatureName(i - 1)) {
+        out << ' ' << objective.FeatureName(i) << '=';
+      }
+      out << ' ' << feature_values[i];
+    }
+    out << " ||| " << derivation.score << '\n';
+  }
+}
+
 } // namespace decode
@@ -4,17 +4,21 @@
 #include <string>
 #include <vector>
 
+#include <stdint.h>
+
 #include <boost/unordered_map.hpp>
 #include <boost/utility.hpp>
 
 namespace util {
-class FileStream;
+class StringStream;
 }
 
 namespace decode {
 
 class Hypothesis;
+class Objective;
 class VocabMap;
+struct Derivation;
 struct FeatureInit;
 
 struct ScoreHistory {
@@ -25,9 +29,15 @@ struct ScoreHistory {
 typedef boost::unordered_map<std::string, ScoreHistory> ScoreHistoryMap;
 
 void Output(const Hypothesis &hypo, const VocabMap &vocab,
-    ScoreHistoryMap &map, util::FileStream &out,
+    ScoreHistoryMap &map, util::StringStream &out,
     const FeatureInit &feature_init, bool verbose);
 
+// Write derivations in Moses n-best format, one per line:
+//   sentence ||| target words ||| name= values name= values ||| score
+// Feature values are only available if the objective stores them.
+void OutputNBest(uint64_t sentence, const std::vector<Derivation> &derivations,
+    const VocabMap &vocab, Objective &objective, util::StringStream &out);
+
 } // namespace decode
 
 #endif // DECODE_OUTPUT__
@@ -10,6 +10,10 @@ class Passthrough : public Feature {
   public:
     Passthrough() : Feature("passthrough") {}
 
+    ScoreMethods UsedScoreMethods() const override {
+      return kScoreTargetPhrase;
+    }
+
     void Init(FeatureInit &feature_init) override {}
 
     static const StringPiece Name();
@@ -8,6 +8,10 @@ class PhraseCountFeature : public Feature {
   public:
     PhraseCountFeature() : Feature("phrase_insertion") {}
 
+    ScoreMethods UsedScoreMethods() const override {
+      return kScoreTargetPhrase;
+    }
+
     void Init(FeatureInit &feature_init) override {}
 
     void NewWord(const StringPiece string_rep, VocabWord *word) const override {}
@@ -0,0 +1,225 @@
+#include "decode/prefork.hh"
+
+#include "decode/server.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+#include "util/file_piece.hh"
+#include "util/file_stream.hh"
+#include "util/usage.hh"
+
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace decode {
+
+namespace {
+
+struct Worker {
+  pid_t pid;
+  // Parent's ends of the pipes.
+  util::scoped_fd requests, answers;
+  // Ids of the requests sent to the worker and not yet answered.
+  std::unordered_multiset<std::string> outstanding;
+  bool alive = true;
+};
+
+class Dispatcher {
+  public:
+    Dispatcher(std::vector<Worker> &workers, int out, Latencies &latencies, std::size_t report_every)
+      : workers_(workers), out_(out), latencies_(latencies), report_every_(report_every), lines_(0) {}
+
+    // Copy answers from worker until it closes its pipe.
+    void CopyAnswers(Worker &worker) {
+      util::FilePiece answers(worker.answers.release());
+      try {
+        while (true) {
+          StringPiece line(answers.ReadLine());
+          StringPiece id(line.data(), std::find(line.data(), line.data() + line.size(), '\t') - line.data());
+          boost::unique_lock<boost::mutex> lock(mutex_);
+          out_ << line << '\n';
+          out_.flush();
+          auto sent = worker.outstanding.find(id.as_string());
+          if (sent != worker.outstanding.end()) worker.outstanding.erase(sent);
+          Answered(id);
+        }
+      } catch (const util::EndOfFileException &e) {}
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      // Every request gets an answer line, even if its worker died.
+      if (!worker.outstanding.empty()) {
+        std::cerr << "Worker process " << worker.pid << " stopped with " << worker.outstanding.size() << " requests unanswered" << std::endl;
+        for (const std::string &id : worker.outstanding) {
+          WriteError(out_, id, "worker exited");
+          Answered(id);
+        }
+        out_.flush();
+        worker.outstanding.clear();
+      }
+      worker.alive = false;
+    }
+
+    // Send line to the least busy worker that is still alive.
+    void Send(StringPiece line) {
+      double start = util::WallTime();
+      const char *tab = std::find(line.data(), line.data() + line.size(), '\t');
+      // Number lines without an id here, since workers only count their own.
+      line_.clear();
+      if (tab == line.data() + line.size()) {
+        line_ = std::to_string(lines_);
+        line_ += '\t';
+      }
+      line_.append(line.data(), line.size());
+      line_ += '\n';
+      ++lines_;
+      const std::string id(line_, 0, line_.find('\t'));
+      {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        started_[id].push_back(start);
+      }
+      while (true) {
+        Worker *best = NULL;
+        {
+          boost::unique_lock<boost::mutex> lock(mutex_);
+          for (Worker &worker : workers_) {
+            if (worker.alive && (!best || worker.outstanding.size() < best->outstanding.size())) best = &worker;
+          }
+          UTIL_THROW_IF2(!best, "Every worker process has stopped.");
+          best->outstanding.insert(id);
+        }
+        try {
+          // One write so a dying worker cannot receive half a request.
+          util::WriteOrThrow(best->requests.get(), line_.data(), line_.size());
+          return;
+        } catch (const util::ErrnoException &e) {
+          boost::unique_lock<boost::mutex> lock(mutex_);
+          best->alive = false;
+          auto sent = best->outstanding.find(id);
+          // Already answered with an error if the worker's answers ended.
+          if (sent == best->outstanding.end()) return;
+          best->outstanding.erase(sent);
+        }
+      }
+    }
+
+  private:
+    // Call with mutex_ held.
+    void Answered(StringPiece id) {
+      auto found = started_.find(id.as_string());
+      // Not a request id if a worker wrote something unexpected.
+      if (found == started_.end()) return;
+      latencies_.Add(util::WallTime() - found->second.front());
+      found->second.pop_front();
+      if (found->second.empty()) started_.erase(found);
+      if (report_every_ && latencies_.Count() % report_every_ == 0) {
+        latencies_.Report(std::cerr);
+      }
+    }
+
+    std::vector<Worker> &workers_;
+
+    boost::mutex mutex_;
+    util::FileStream out_;
+
+    Latencies &latencies_;
+    const std::size_t report_every_;
+    // When unanswered requests were read, by id.  Clients may reuse ids, so
+    // answers match them in order.
+    std::unordered_map<std::string, std::deque<double> > started_;
+
+    std::string line_;
+    uint64_t lines_;
+};
+
+void Pipe(int fds[2]) {
+  UTIL_THROW_IF(pipe(fds), util::ErrnoException, "Failed to make a pipe");
+}
+
+} // namespace
+
+void PreforkServe(std::size_t processes, int in, int out, const boost::function<void (int requests, int answers)> &serve, Latencies &latencies, std::size_t report_every) {
+  UTIL_THROW_IF2(!processes, "Need at least one worker process");
+  // A worker that died would otherwise kill the parent on the next write.
+  signal(SIGPIPE, SIG_IGN);
+  std::vector<Worker> workers(processes);
+  for (std::size_t i = 0; i < processes; ++i) {
+    int requests[2], answers[2];
+    Pipe(requests);
+    Pipe(answers);
+    pid_t pid = fork();
+    UTIL_THROW_IF(pid == -1, util::ErrnoException, "fork failed");
+    if (!pid) {
+      // Worker.  Close the parent's ends, including those of earlier workers,
+      // so they see end of file when the parent is done.
+      for (std::size_t j = 0; j < i; ++j) {
+        workers[j].requests.reset();
+        workers[j].answers.reset();
+      }
+      close(requests[1]);
+      close(answers[0]);
+      int status = 0;
+      try {
+        serve(requests[0], answers[1]);
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        status = 1;
+      }
+      std::cerr.flush();
+      // Skip destructors for the parent's objects, which would only dirty
+      // shared pages.
+      _exit(status);
+    }
+    close(requests[0]);
+    close(answers[1]);
+    workers[i].pid = pid;
+    workers[i].requests.reset(requests[1]);
+    workers[i].answers.reset(answers[0]);
+  }
+
+  Dispatcher dispatcher(workers, out, latencies, report_every);
+  boost::ptr_vector<boost::thread> readers;
+  for (Worker &worker : workers) {
+    readers.push_back(new boost::thread(&Dispatcher::CopyAnswers, &dispatcher, boost::ref(worker)));
+  }
+  // Workers must be told to stop and waited for even if this fails.
+  bool failed = false;
+  try {
+    util::FilePiece requests(in);
+    while (true) {
+      dispatcher.Send(requests.ReadLine());
+    }
+  } catch (const util::EndOfFileException &e) {
+  } catch (const util::Exception &e) {
+    std::cerr << e.what() << std::endl;
+    failed = true;
+  }
+  for (Worker &worker : workers) {
+    worker.requests.reset();
+  }
+  for (boost::thread &reader : readers) {
+    reader.join();
+  }
+  for (Worker &worker : workers) {
+    int status;
+    UTIL_THROW_IF(waitpid(worker.pid, &status, 0) == -1, util::ErrnoException, "waitpid failed");
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+      std::cerr << "Worker process " << worker.pid << " failed with status " << status << std::endl;
+    }
+  }
+  UTIL_THROW_IF2(failed, "Stopped serving before the end of the requests.");
+}
+
+} // namespace decode
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <boost/function.hpp>
+
+#include <cstddef>
+
+/* Serve from several worker processes that share the loaded models.  The
+ * caller loads the phrase table, language model, vocabulary, and prewarmed
+ * cache, then PreforkServe forks.  Workers see all of it copy-on-write, so
+ * what they only read stays in one copy of physical memory and none of them
+ * warms up again.  Each worker is its own process, so one crashing does not
+ * take the others down.
+ *
+ * The parent reads request lines and hands each to the worker with the
+ * fewest unanswered requests, then copies answer lines to the output as they
+ * arrive.  Each request must produce exactly one answer line starting with
+ * its id, as decode::Server does.  The parent numbers lines without an id
+ * itself, so ids count lines across all workers, and it measures latency
+ * over all workers by matching answers to requests by id.  When a worker
+ * dies, its unanswered requests are answered with id<TAB>error: worker
+ * exited and it gets no more.
+ */
+namespace decode {
+
+class Latencies;
+
+// Fork processes workers, each running serve(requests, answers) on pipe file
+// descriptors that it owns.  Call before starting any threads.  Reads
+// requests from in until end of file and writes answers to out, then waits
+// for the workers.  Latencies are added as answers are written and reported
+// every report_every answers, 0 for never.  Throws if every worker died.
+void PreforkServe(std::size_t processes, int in, int out, const boost::function<void (int requests, int answers)> &serve, Latencies &latencies, std::size_t report_every = 0);
+
+} // namespace decode
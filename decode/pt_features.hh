@@ -10,6 +10,10 @@ class PhraseTableFeatures : public Feature {
 
     PhraseTableFeatures() : Feature("phrase_table") {}
 
+    ScoreMethods UsedScoreMethods() const override {
+      return kScoreTargetPhrase;
+    }
+
     void Init(FeatureInit &feature_init) override {
       UTIL_THROW_IF(!feature_init.phrase_access.dense_features, util::Exception,
           "requested phrase table score but feature values are missing in phrase access");
@@ -1,4 +1,5 @@
 #include "decode/score_collector.hh"
+#include "util/murmur_hash.hh"
 #include <iostream>
 
 namespace decode {
@@ -11,5 +12,11 @@ void ScoreCollector::AddDense(std::size_t index, float value) {
   score_ += weights_[global_index] * value;
 }
 
+void ScoreCollector::AddRecombinationKey(uint64_t key) {
+  assert(new_hypothesis_);
+  uint64_t &hash = recombination_field_(new_hypothesis_);
+  hash = util::MurmurHashNative(&key, sizeof(uint64_t), hash);
+}
+
 
 } // namespace decode
@@ -38,11 +38,13 @@ class ScoreCollector {
         const std::vector<float> &weights,
         Hypothesis *&new_hypothesis,
         util::Pool *hypothesis_pool,
-        FeatureStore dense_features) :
+        FeatureStore dense_features,
+        const util::PODField<uint64_t> recombination_field) :
       weights_(weights),
       new_hypothesis_(new_hypothesis),
       hypothesis_pool_(hypothesis_pool),
-      dense_features_(dense_features) {}
+      dense_features_(dense_features),
+      recombination_field_(recombination_field) {}
 
     void SetDenseOffset(std::size_t offset) {
       dense_feature_offset_ = offset;
@@ -62,6 +64,12 @@ class ScoreCollector {
 
     void AddDense(std::size_t index, float value);
 
+    /* Hypotheses recombine only if their keys agree, so a feature whose
+     * state affects later scores adds that state here.  Only valid when
+     * scoring a new hypothesis.
+     */
+    void AddRecombinationKey(uint64_t key);
+
     // TODO (later)
     /* SparseNameBuilder getSparseNameBuilder(float); */
 
@@ -72,6 +80,7 @@ class ScoreCollector {
     util::Pool *hypothesis_pool_;
     std::size_t dense_feature_offset_;
     FeatureStore dense_features_;
+    const util::PODField<uint64_t> recombination_field_;
 };
 
 } // namespace decode
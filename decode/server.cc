@@ -0,0 +1,97 @@
+#include "decode/server.hh"
+
+#include "util/file_stream.hh"
+#include "util/usage.hh"
+
+#include <boost/utility/in_place_factory.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+namespace decode {
+
+double Latencies::Percentile(double percent) const {
+  if (seconds_.empty()) return 0.0;
+  if (sorted_ != seconds_.size()) {
+    std::sort(seconds_.begin(), seconds_.end());
+    sorted_ = seconds_.size();
+  }
+  std::size_t rank = static_cast<std::size_t>(std::ceil(percent / 100.0 * seconds_.size()));
+  return seconds_[std::max<std::size_t>(rank, 1) - 1];
+}
+
+void Latencies::Report(std::ostream &to) const {
+  double mean = seconds_.empty() ? 0.0 : std::accumulate(seconds_.begin(), seconds_.end(), 0.0) / seconds_.size();
+  to << "latency ms: requests " << seconds_.size()
+    << " mean " << mean * 1000.0
+    << " p50 " << Percentile(50.0) * 1000.0
+    << " p90 " << Percentile(90.0) * 1000.0
+    << " p99 " << Percentile(99.0) * 1000.0
+    << " max " << Percentile(100.0) * 1000.0 << '\n';
+}
+
+void WriteError(util::FileStream &out, StringPiece id, std::string message) {
+  std::replace(message.begin(), message.end(), '\n', ' ');
+  out << id << "\terror: " << message << '\n';
+}
+
+ServerOutputWorker::ServerOutputWorker(std::vector<ServerRequest> &requests, util::FileStream &out, bool verbose, Latencies &latencies, std::size_t report_every, util::PCQueue<Request> &done)
+  : requests_(requests), out_(out), verbose_(verbose), latencies_(latencies), report_every_(report_every), done_(done) {}
+
+void ServerOutputWorker::operator()(Request request) {
+  // The server does not write n-best lists or lattices, so sequence is free
+  // to say which request a translation belongs to.
+  ServerRequest &server = requests_[request->sequence];
+  if (request->error.empty()) {
+    out_ << server.id << '\t' << request->output.str();
+  } else {
+    WriteError(out_, server.id, request->error);
+  }
+  out_.flush();
+  latencies_.Add(util::WallTime() - server.start);
+  if (verbose_) {
+    std::cerr << "request " << server.id << '\n' << request->log.str() << std::flush;
+  }
+  if (report_every_ && latencies_.Count() % report_every_ == 0) {
+    latencies_.Report(std::cerr);
+  }
+  request->output.str(std::string());
+  request->log.str(std::string());
+  done_.Produce(request);
+}
+
+Server::Server(const std::vector<Replica> &replicas, const OutputOptions &options, std::size_t threads, util::FileStream &out, Latencies &latencies, std::size_t report_every)
+  // Enough buffers to keep every thread busy while requests queue.
+  : requests_(threads * 4),
+    recycle_(requests_.size()),
+    replicas_(replicas),
+    next_replica_(0),
+    output_(requests_.size(), 1, boost::in_place(boost::ref(requests_), boost::ref(out), options.verbose, boost::ref(latencies), report_every, boost::ref(recycle_)), NULL),
+    decode_(requests_.size(), threads, boost::in_place(boost::cref(replicas_), boost::ref(next_replica_), boost::cref(options), boost::ref(output_.In())), NULL),
+    lines_(0) {
+  for (std::size_t i = 0; i < requests_.size(); ++i) {
+    requests_[i].translation.sequence = i;
+    recycle_.Produce(&requests_[i].translation);
+  }
+}
+
+void Server::Add(StringPiece line) {
+  double start = util::WallTime();
+  Translation *translation = recycle_.Consume();
+  ServerRequest &request = requests_[translation->sequence];
+  request.start = start;
+  const char *tab = std::find(line.data(), line.data() + line.size(), '\t');
+  if (tab == line.data() + line.size()) {
+    request.id = std::to_string(lines_);
+    request.translation.input.assign(line.data(), line.size());
+  } else {
+    request.id.assign(line.data(), tab);
+    request.translation.input.assign(tab + 1, line.data() + line.size());
+  }
+  ++lines_;
+  decode_.Produce(translation);
+}
+
+} // namespace decode
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "decode/decode.hh"
+#include "decode/thread.hh"
+#include "util/string_piece.hh"
+#include "util/thread_pool.hh"
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace util { class FileStream; }
+
+/* Long-running decoding with the models kept loaded.  Each request is a line
+ *   id<TAB>sentence
+ * and is answered with
+ *   id<TAB>translation
+ * as soon as it is done, so answers can come out of order.  A request that
+ * fails to decode is answered with
+ *   id<TAB>error: message
+ * and the server carries on.  A line without a
+ * tab is its own sentence and its id is its line number, counting from 0.
+ * Requests queue for the decoding threads, so a client can have many in
+ * flight and they are decoded as threads come free.
+ */
+namespace decode {
+
+// Request latency, from reading the request to writing its answer.
+class Latencies {
+  public:
+    void Add(double seconds) { seconds_.push_back(seconds); }
+
+    std::size_t Count() const { return seconds_.size(); }
+
+    // Nearest-rank percentile in seconds, 0 with no requests.
+    double Percentile(double percent) const;
+
+    // One line: count, mean, and the 50th, 90th, 99th, and 100th percentiles
+    // in milliseconds.
+    void Report(std::ostream &to) const;
+
+  private:
+    // Sorted lazily by Percentile.
+    mutable std::vector<double> seconds_;
+    mutable std::size_t sorted_ = 0;
+};
+
+// Write the answer id<TAB>error: message, keeping it on one line.
+void WriteError(util::FileStream &out, StringPiece id, std::string message);
+
+struct ServerRequest {
+  std::string id;
+  double start;
+  Translation translation;
+};
+
+class ServerOutputWorker {
+  public:
+    typedef Translation *Request;
+
+    // Report latencies every report_every answers, 0 for never.
+    ServerOutputWorker(std::vector<ServerRequest> &requests, util::FileStream &out, bool verbose, Latencies &latencies, std::size_t report_every, util::PCQueue<Request> &done);
+
+    void operator()(Request request);
+
+  private:
+    std::vector<ServerRequest> &requests_;
+    util::FileStream &out_;
+    const bool verbose_;
+    Latencies &latencies_;
+    const std::size_t report_every_;
+
+    util::PCQueue<Request> &done_;
+};
+
+class Server {
+  public:
+    // Latencies are added as answers are written; read them after the
+    // Server is destroyed.
+    Server(const std::vector<Replica> &replicas, const OutputOptions &options, std::size_t threads, util::FileStream &out, Latencies &latencies, std::size_t report_every = 0);
+
+    // Queue a request line.  Blocks if all buffers are in flight.
+    void Add(StringPiece line);
+
+    // The destructor waits for every queued request to be answered.
+
+  private:
+    std::vector<ServerRequest> requests_;
+
+    util::PCQueue<Translation*> recycle_;
+
+    std::vector<Replica> replicas_;
+    std::size_t next_replica_;
+
+    // Order matters: decoding threads are joined before the output thread.
+    util::ThreadPool<ServerOutputWorker> output_;
+    util::ThreadPool<DecodeWorker> decode_;
+
+    uint64_t lines_;
+};
+
+} // namespace decode
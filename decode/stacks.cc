@@ -4,11 +4,15 @@
 #include "decode/future.hh"
 #include "decode/hypothesis.hh"
 #include "search/edge_generator.hh"
-#include "util/murmur_hash.hh"
 #include "util/mutable_vocab.hh"
 
 #include <iostream>
 #include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 namespace decode {
 
@@ -49,39 +53,59 @@ void AddEdge(search::Vertex &hypos, search::Vertex &extensions, search::Note not
   out.AddEdge(edge);
 }
 
-struct IntPairHash : public std::unary_function<const search::IntPair &, std::size_t> {
-  std::size_t operator()(const search::IntPair &p) const {
-    return util::MurmurHashNative(&p, sizeof(search::IntPair));
-  }
-};
-
+// Hypotheses grouped by the source span they will cover next, one vertex per
+// span.  Spans are banded like Chart: begin * max_phrase_length + length - 1.
+// The vertices belong to Stacks and are reused for every stack and sentence
+// so they keep their memory.  They are all empty between stacks.
 class Vertices {
   public:
-    explicit Vertices(FeatureInit &feature_init) : feature_init_(feature_init) {}
+    Vertices(FeatureInit &feature_init, std::size_t sentence_length, std::size_t max_phrase_length, std::vector<search::Vertex> &vertices)
+      : feature_init_(feature_init),
+        max_phrase_length_(max_phrase_length),
+        vertices_(vertices) {
+      if (vertices_.size() < sentence_length * max_phrase_length) {
+        vertices_.resize(sentence_length * max_phrase_length);
+      }
+    }
 
     void Add(const Hypothesis *hypothesis, uint32_t source_begin, uint32_t source_end,
         Hypothesis *next_hypothesis, float score_delta) {
-      search::IntPair key;
-      key.first = source_begin;
-      key.second = source_end;
-      AddHypothesisToVertex(hypothesis, score_delta, next_hypothesis, map_[key], feature_init_);
+      assert(source_end > source_begin);
+      assert(source_end - source_begin <= max_phrase_length_);
+      std::size_t index = source_begin * max_phrase_length_ + source_end - source_begin - 1;
+      search::Vertex &vertex = vertices_[index];
+      if (vertex.Root().Hypos().empty()) used_.push_back(index);
+      AddHypothesisToVertex(hypothesis, score_delta, next_hypothesis, vertex, feature_init_);
     }
 
     void Apply(Chart &chart, search::EdgeGenerator &out) {
-      for (Map::iterator i = map_.begin(); i != map_.end(); ++i) {
+      for (std::size_t index : used_) {
         // Record source range in the note for the edge.
         search::Note note;
-        note.ints = i->first;
-        AddEdge(i->second, *chart.Range(note.ints.first, note.ints.second), note, out);
+        note.ints.first = index / max_phrase_length_;
+        note.ints.second = note.ints.first + index % max_phrase_length_ + 1;
+        AddEdge(vertices_[index], *chart.Range(note.ints.first, note.ints.second), note, out);
       }
     }
 
+    // Empty the vertices used by the last stack.  Call after search is done
+    // with them.
+    void Reset() {
+      for (std::size_t index : used_) {
+        vertices_[index].Root().InitRoot();
+      }
+      used_.clear();
+    }
+
   private:
     FeatureInit &feature_init_;
-    // TODO: dense as 2D array?
-    // Key is start and end
-    typedef boost::unordered_map<search::IntPair, search::Vertex, IntPairHash> Map;
-    Map map_;
+
+    const std::size_t max_phrase_length_;
+
+    std::vector<search::Vertex> &vertices_;
+
+    // Indices into vertices_ with hypotheses, in order of first use.
+    std::vector<std::size_t> used_;
 };
 
 struct MergeInfo {
@@ -91,30 +115,68 @@ struct MergeInfo {
   float lm_weight;
 };
 
-template <class LMState>
-class Recombinator : public std::hash<const Hypothesis*>, public std::equal_to<const Hypothesis*> {
+/* Hypotheses in a stack by recombination hash (see
+ * FeatureInit::recombination_field), which was computed as they were built.
+ * Open addressing with linear probing in a power of two table at most half
+ * full: a stack holds at most the pop limit's worth of hypotheses.  Equal
+ * hashes are confirmed on the state every hypothesis has; feature state is
+ * only compared by hash.
+ */
+class RecombinationTable {
   public:
-    Recombinator(
-        const util::PODField<LMState> lm_state_field,
-        const Objective &objective)
-      : lm_state_field_(lm_state_field), objective_(objective) {}
-
-    size_t operator()(const Hypothesis *hypothesis) const {
-      std::size_t source_index = hypothesis->SourceEndIndex();
-      return util::MurmurHashNative(&source_index, sizeof(std::size_t),
-          hash_value(lm_state_field_(hypothesis), hash_value(hypothesis->GetCoverage())));
+    RecombinationTable(const FeatureInit &feature_init, const Objective &objective, std::size_t pop_limit)
+      : hash_field_(feature_init.recombination_field),
+        lm_state_field_(feature_init.lm_state_field),
+        objective_(objective) {
+      std::size_t buckets = 2;
+      while (buckets < 2 * pop_limit) buckets *= 2;
+      table_.resize(buckets);
+      mask_ = buckets - 1;
+    }
+
+    // A hypothesis and where it is in the stack.
+    struct Slot {
+      Hypothesis *hypothesis;
+      std::size_t index;
+    };
+
+    // Empty the table for the next stack.
+    void Clear() {
+      Slot empty = {NULL, 0};
+      std::fill(table_.begin(), table_.end(), empty);
     }
 
-    bool operator()(const Hypothesis *first, const Hypothesis *second) const {
-      if (! (lm_state_field_(first) == lm_state_field_(second))) return false;
-      if (! (first->GetCoverage() == second->GetCoverage())) return false;
-      if (! (first->SourceEndIndex() == second->SourceEndIndex())) return false;
-      return objective_.HypothesisEqual(*first, *second);
+    // Return the slot holding a hypothesis that recombines with hypothesis,
+    // or put hypothesis and its index in the stack in an empty slot and
+    // return NULL.
+    Slot *FindOrInsert(Hypothesis *hypothesis, std::size_t index) {
+      const uint64_t hash = hash_field_(hypothesis);
+      for (std::size_t i = hash & mask_; ; i = (i + 1) & mask_) {
+        Slot &slot = table_[i];
+        if (!slot.hypothesis) {
+          slot.hypothesis = hypothesis;
+          slot.index = index;
+          return NULL;
+        }
+        if (hash_field_(slot.hypothesis) == hash && Equal(*slot.hypothesis, *hypothesis)) return &slot;
+      }
     }
 
   private:
+    bool Equal(const Hypothesis &first, const Hypothesis &second) const {
+      bool ret = (first.SourceEndIndex() == second.SourceEndIndex()) &&
+        (first.GetCoverage() == second.GetCoverage()) &&
+        (lm_state_field_(&first) == lm_state_field_(&second));
+      assert(!ret || objective_.HypothesisEqual(first, second));
+      return ret;
+    }
+
+    const util::PODField<uint64_t> hash_field_;
     const util::PODField<LMState> lm_state_field_;
     const Objective &objective_;
+
+    std::vector<Slot> table_;
+    std::size_t mask_;
 };
 
 Hypothesis *GetHypothesis(search::PartialEdge complete) {
@@ -158,13 +220,13 @@ void UpdateHypothesisInEdge(search::PartialEdge complete, MergeInfo &merge_info)
   complete.SetScore(score);
 }
 
-// TODO n-best lists.
 class EdgeOutput {
   public:
-    typedef boost::unordered_set<Hypothesis *, Recombinator<LMState>, Recombinator<LMState>> Dedupe;
-
-    EdgeOutput(Stack &stack, MergeInfo merge_info, Dedupe deduper, search::EdgeGenerator &gen)
-      : stack_(stack), merge_info_(merge_info), deduper_(deduper), queue_(gen) {}
+    // deduper is cleared and reused.
+    EdgeOutput(Stack &stack, MergeInfo merge_info, RecombinationTable &deduper, search::EdgeGenerator &gen, Stats &stats)
+      : stack_(stack), merge_info_(merge_info), deduper_(deduper), queue_(gen), stats_(stats) {
+      deduper_.Clear();
+    }
 
     bool NewHypothesis(search::PartialEdge complete) {
       if (!IsCompleteHypothesis(complete)) {
@@ -172,21 +234,23 @@ class EdgeOutput {
         queue_.AddEdge(complete);
         return false;
       }
-      stack_.push_back(GetHypothesis(complete));
-      // Note: stack_ has reserved for pop limit so pointers should survive.
-      std::pair<Dedupe::iterator, bool> res(deduper_.insert(stack_.back()));
-      if (!res.second) {
-        // Already present.  Keep the top-scoring one.
-        Hypothesis *already = *res.first;
-        if (already->GetScore() < stack_.back()->GetScore()) {
-          already->SetScore(stack_.back()->GetScore());
-          for (Hypothesis *h : stack_) {
-            if (h == already) {
-              h = stack_.back();
-            }
-          }
-        }
-        stack_.resize(stack_.size() - 1);
+      DECODE_STATS_ADD(stats_.hypotheses, 1);
+      Hypothesis *added = GetHypothesis(complete);
+      RecombinationTable::Slot *slot = deduper_.FindOrInsert(added, stack_.size());
+      if (!slot) {
+        stack_.push_back(added);
+        return true;
+      }
+      // Already present.  Keep the top-scoring one and remember the other as
+      // an alternative for n-best lists.
+      DECODE_STATS_ADD(stats_.recombinations, 1);
+      Hypothesis *already = slot->hypothesis;
+      if (already->GetScore() < added->GetScore()) {
+        stack_[slot->index] = added;
+        slot->hypothesis = added;
+        added->AddRecombined(already);
+      } else {
+        already->AddRecombined(added);
       }
       return true;
     }
@@ -194,16 +258,19 @@ class EdgeOutput {
     void FinishedSearch() {}
 
   private:
-    Dedupe deduper_;
+    RecombinationTable &deduper_;
 
     Stack &stack_;
 
     search::EdgeGenerator &queue_;
 
     MergeInfo merge_info_;
+
+    Stats &stats_;
 };
 
-// Pick only the best hypothesis for end of sentence.
+// Pick the best hypothesis for end of sentence.  The others are recombined
+// into it so they can appear in n-best lists.
 class PickBest {
   public:
     PickBest(Stack &stack, MergeInfo merge_info, search::EdgeGenerator &gen) :
@@ -220,8 +287,13 @@ class PickBest {
       }
       Hypothesis *new_hypo = GetHypothesis(complete);
       new_hypo->SetScore(new_hypo->GetScore() + merge_info_.objective.ScoreFinalHypothesis(*new_hypo));
-      if (best_ == NULL || new_hypo->GetScore() > best_->GetScore()) {
+      if (best_ == NULL) {
+        best_ = new_hypo;
+      } else if (new_hypo->GetScore() > best_->GetScore()) {
+        new_hypo->AddRecombined(best_);
         best_ = new_hypo;
+      } else {
+        best_->AddRecombined(new_hypo);
       }
       return true;
     }
@@ -240,31 +312,77 @@ class PickBest {
 
 } // namespace
 
-Stacks::Stacks(System &system, Chart &chart) :
-  hypothesis_builder_(hypothesis_pool_, system.GetObjective().GetFeatureInit()) {
+// Scores include future costs, so hypotheses in the same stack are
+// comparable.
+std::size_t PruneStack(Stack &stack, const Config &config) {
+  if (stack.empty() || (config.beam_threshold == std::numeric_limits<float>::infinity() && !config.coverage_limit))
+    return stack.size();
+  float best = -std::numeric_limits<float>::infinity();
+  for (const Hypothesis *h : stack) {
+    best = std::max(best, h->GetScore());
+  }
+  const float threshold = best - config.beam_threshold;
+  if (!config.coverage_limit) {
+    return std::stable_partition(stack.begin(), stack.end(),
+        [threshold](const Hypothesis *h) { return h->GetScore() >= threshold; }) - stack.begin();
+  }
+  // Keep the top hypotheses for each coverage.
+  std::vector<Hypothesis*> sorted(stack);
+  std::stable_sort(sorted.begin(), sorted.end(),
+      [](const Hypothesis *a, const Hypothesis *b) { return a->GetScore() > b->GetScore(); });
+  boost::unordered_map<Coverage, std::size_t> counts;
+  boost::unordered_set<const Hypothesis*> keep;
+  for (const Hypothesis *h : sorted) {
+    if (h->GetScore() < threshold) break;
+    if (++counts[h->GetCoverage()] <= config.coverage_limit) keep.insert(h);
+  }
+  return std::stable_partition(stack.begin(), stack.end(),
+      [&keep](const Hypothesis *h) { return keep.count(h); }) - stack.begin();
+}
+
+void Stacks::Decode(System &system, Chart &chart) {
+  for (Stack &stack : stacks_) {
+    stack.clear();
+    spare_.push_back(std::move(stack));
+  }
+  stacks_.clear();
+  hypothesis_pool_.Reset();
+  antecedents_.clear();
+  coverages_.clear();
+  coverage_begin_.clear();
+  skipped_edges_ = 0;
+  stats_ = Stats();
+  end_ = NULL;
+
   FeatureInit &feature_init = system.GetObjective().GetFeatureInit();
+  HypothesisBuilder hypothesis_builder(hypothesis_pool_, feature_init);
   Future future(chart);
   // Reservation is critical because pointers to Hypothesis objects are retained as history.
   stacks_.reserve(chart.SentenceLength() + 2 /* begin/end of sentence */);
-  stacks_.resize(1);
   // Initialize root hypothesis with <s> context and future cost for everything.
   pt::Access access = feature_init.phrase_access;
   pt::Row *target = access.Allocate(hypothesis_pool_);
   system.GetObjective().InitPassthroughPhrase(target, TargetPhraseType::Begin);
-  stacks_[0].push_back(hypothesis_builder_.BuildHypothesis(
+  NewStack().push_back(hypothesis_builder.BuildHypothesis(
         system.GetObjective().BeginSentenceState(),
         future.Full(), target));
+  antecedents_.push_back(1);
+  AppendCoverages(stacks_[0]);
+  Vertices vertices(feature_init, chart.SentenceLength(), chart.MaxSourcePhraseLength(), vertices_);
+  RecombinationTable deduper(feature_init, system.GetObjective(), system.SearchContext().PopLimit());
   // Decode with increasing numbers of source words.
   for (std::size_t source_words = 1; source_words <= chart.SentenceLength(); ++source_words) {
-    Vertices vertices(feature_init);
     // Iterate over stacks to continue from.
     for (std::size_t from = source_words - std::min(source_words, chart.MaxSourcePhraseLength());
          from < source_words;
          ++from) {
       const std::size_t phrase_length = source_words - from;
       // Iterate over antecedents in this stack.
-      for (Stack::const_iterator ant = stacks_[from].begin(); ant != stacks_[from].end(); ++ant) {
-        const Coverage &coverage = (*ant)->GetCoverage();
+      const Stack &ants = stacks_[from];
+      const Coverage *coverages = coverages_.data() + coverage_begin_[from];
+      for (std::size_t ant = 0; ant < ants.size(); ++ant) {
+        const bool pruned = (ant >= antecedents_[from]);
+        const Coverage &coverage = coverages[ant];
         std::size_t begin = coverage.FirstZero();
         const std::size_t last_end = std::min(coverage.FirstZero() + system.GetConfig().reordering_limit, chart.SentenceLength());
         const std::size_t last_begin = (last_end > phrase_length) ? (last_end - phrase_length) : 0;
@@ -272,38 +390,63 @@ Stacks::Stacks(System &system, Chart &chart) :
         do {
           const TargetPhrases *phrases = chart.Range(begin, begin + phrase_length);
           if (!phrases || !coverage.Compatible(begin, begin + phrase_length)) continue;
-          const Hypothesis *ant_hypo = *ant;
-          Hypothesis *next_hypo = hypothesis_builder_.NextHypothesis(ant_hypo);
+          if (pruned) {
+            ++skipped_edges_;
+            continue;
+          }
+          const Hypothesis *ant_hypo = ants[ant];
+          Hypothesis *next_hypo = hypothesis_builder.NextHypothesis(ant_hypo);
           float score_delta = system.GetObjective().ScoreHypothesisWithSourcePhrase(
               *ant_hypo, SourcePhrase(chart.Sentence(), begin, begin + phrase_length), next_hypo);
           // Future costs: remove span to be filled.
           score_delta += future.Change(coverage, begin, begin + phrase_length);
           next_hypo->SetScore(ant_hypo->GetScore() + score_delta);
-          vertices.Add(*ant, begin, begin + phrase_length, next_hypo, score_delta);
+          vertices.Add(ant_hypo, begin, begin + phrase_length, next_hypo, score_delta);
         // Enforce the reordering limit on later iterations.
         } while (++begin <= last_begin);
       }
     }
-    search::EdgeGenerator gen;
-    vertices.Apply(chart, gen);
-    stacks_.resize(stacks_.size() + 1);
-    stacks_.back().reserve(system.SearchContext().PopLimit());
-    Recombinator<LMState> recombinator(feature_init.lm_state_field, system.GetObjective());
-    EdgeOutput::Dedupe deduper(system.SearchContext().PopLimit(), recombinator, recombinator);
-    MergeInfo merge_info{system.GetObjective(), hypothesis_builder_, chart, system.SearchContext().LMWeight()};
-    EdgeOutput output(stacks_.back(), merge_info, deduper, gen);
-    gen.Search(system.SearchContext(), output);
+    gen_.Clear();
+    vertices.Apply(chart, gen_);
+    Stack &stack = NewStack();
+    stack.reserve(system.SearchContext().PopLimit());
+    MergeInfo merge_info{system.GetObjective(), hypothesis_builder, chart, system.SearchContext().LMWeight()};
+    EdgeOutput output(stack, merge_info, deduper, gen_, stats_);
+    gen_.Search(system.SearchContext(), output);
+    DECODE_STATS_ADD(stats_.edges_pushed, gen_.Pushed());
+    DECODE_STATS_ADD(stats_.edges_popped, gen_.Popped());
+    vertices.Reset();
+    antecedents_.push_back(PruneStack(stack, system.GetConfig()));
+    AppendCoverages(stack);
+  }
+  PopulateLastStack(system, chart, hypothesis_builder, antecedents_.back());
+}
+
+void Stacks::AppendCoverages(const Stack &stack) {
+  coverage_begin_.push_back(coverages_.size());
+  for (const Hypothesis *hypothesis : stack) {
+    coverages_.push_back(hypothesis->GetCoverage());
   }
-  PopulateLastStack(system, chart);
 }
 
-void Stacks::PopulateLastStack(System &system, Chart &chart) {
+Stack &Stacks::NewStack() {
+  stacks_.emplace_back();
+  if (!spare_.empty()) {
+    stacks_.back().swap(spare_.back());
+    spare_.pop_back();
+  }
+  return stacks_.back();
+}
+
+void Stacks::PopulateLastStack(System &system, Chart &chart, HypothesisBuilder &builder, std::size_t antecedents) {
   // First, make Vertex of all hypotheses
   search::Vertex all_hyps;
-  for (Stack::const_iterator ant = stacks_[chart.SentenceLength()].begin(); ant != stacks_[chart.SentenceLength()].end(); ++ant) {
+  const Stack &last = stacks_[chart.SentenceLength()];
+  skipped_edges_ += last.size() - antecedents;
+  for (Stack::const_iterator ant = last.begin(); ant != last.begin() + antecedents; ++ant) {
     assert(chart.SentenceLength() == (*ant)->GetCoverage().FirstZero());
     const Hypothesis *ant_hypo = *ant;
-    Hypothesis *next_hypo = hypothesis_builder_.NextHypothesis(ant_hypo);
+    Hypothesis *next_hypo = builder.NextHypothesis(ant_hypo);
     SourcePhrase source_phrase(chart.Sentence(), chart.SentenceLength(), chart.SentenceLength());
     float score_delta = system.GetObjective().ScoreHypothesisWithSourcePhrase(
         *ant_hypo, source_phrase, next_hypo);
@@ -315,18 +458,23 @@ void Stacks::PopulateLastStack(System &system, Chart &chart) {
   // The seach algorithm will attempt to find the best hypotheses in the "cross product" of these two sets.
   search::Vertex &eos_vertex = chart.EndOfSentence();
   // Add edge that tacks </s> on
-  search::EdgeGenerator gen;
+  gen_.Clear();
   search::Note note;
   note.ints.first = chart.SentenceLength();
   note.ints.second = chart.SentenceLength();
-  AddEdge(all_hyps, eos_vertex, note, gen);
-
-  stacks_.resize(stacks_.size() + 1);
-  MergeInfo merge_info{system.GetObjective(), hypothesis_builder_, chart,system.SearchContext().LMWeight()};
-  PickBest output(stacks_.back(), merge_info, gen);
-  gen.Search(system.SearchContext(), output);
-
-  end_ = stacks_.back().empty() ? NULL : stacks_.back()[0];
+  AddEdge(all_hyps, eos_vertex, note, gen_);
+
+  Stack &stack = NewStack();
+  MergeInfo merge_info{system.GetObjective(), builder, chart, system.SearchContext().LMWeight()};
+  PickBest output(stack, merge_info, gen_);
+  gen_.Search(system.SearchContext(), output);
+  DECODE_STATS_ADD(stats_.edges_pushed, gen_.Pushed());
+  DECODE_STATS_ADD(stats_.edges_popped, gen_.Popped());
+  DECODE_STATS_ADD(stats_.skipped_edges, skipped_edges_);
+  // The edges point into chart, which may be cleared before the next search.
+  gen_.Clear();
+
+  end_ = stack.empty() ? NULL : stack[0];
 }
 
 } // namespace decode
@@ -2,33 +2,86 @@
 
 #include "decode/system.hh"
 #include "decode/hypothesis_builder.hh"
+#include "decode/stats.hh"
+#include "search/edge_generator.hh"
+#include "search/vertex.hh"
+#include "util/pool.hh"
 
 #include <vector>
 
-namespace search { class EdgeGenerator; }
-
 namespace decode {
 
 class Chart;
 
 typedef std::vector<Hypothesis*> Stack;
 
+// Move the hypotheses in stack worth extending under Config::beam_threshold
+// and Config::coverage_limit to the front, keeping their order, and return
+// how many there are.
+std::size_t PruneStack(Stack &stack, const Config &config);
+
+/* Stack decoding of a chart.  Stacks can be reused for many sentences: each
+ * call to Decode replaces the previous results but keeps the memory, so a
+ * long-lived Stacks stops allocating once it has seen a long sentence.
+ */
 class Stacks {
   public:
-    Stacks(System &system, Chart &chart);
+    Stacks() {}
+
+    Stacks(System &system, Chart &chart) { Decode(system, chart); }
+
+    // Search chart.  Hypotheses from the previous sentence are invalidated.
+    void Decode(System &system, Chart &chart);
 
     // NULL if no hypothesis.
     const Hypothesis *End() const { return end_; }
 
+    // Stacks by number of source words covered.  The root is alone in the
+    // first stack and the last stack holds End(), which the other final
+    // hypotheses recombined into.
+    const std::vector<Stack> &AllStacks() const { return stacks_; }
+
+    // Edges to the chart that were not built because their antecedent was
+    // pruned by Config::beam_threshold or Config::coverage_limit.
+    std::size_t SkippedEdges() const { return skipped_edges_; }
+
+    const Stats &GetStats() const { return stats_; }
+
   private:
-    void PopulateLastStack(System &system, Chart &chart);
+    void PopulateLastStack(System &system, Chart &chart, HypothesisBuilder &builder, std::size_t antecedents);
+
+    // Append an empty stack to stacks_, reusing a vector from spare_.
+    Stack &NewStack();
+
+    // Record the coverage of the hypotheses in the stack just finished.
+    void AppendCoverages(const Stack &stack);
+
     std::vector<Stack> stacks_;
 
+    // Emptied stacks from earlier sentences, kept for their capacity.
+    std::vector<Stack> spare_;
+
     util::Pool hypothesis_pool_;
 
-    HypothesisBuilder hypothesis_builder_;
+    // Hypotheses waiting to be extended, by source span.
+    std::vector<search::Vertex> vertices_;
+
+    search::EdgeGenerator gen_;
+
+    // How many hypotheses at the front of each stack survived pruning.
+    std::vector<std::size_t> antecedents_;
+
+    // Coverage of every hypothesis in stacks_, in order, so the loop over
+    // antecedents reads contiguous memory and only touches the hypotheses
+    // it extends.  Stack i starts at coverage_begin_[i].
+    std::vector<Coverage> coverages_;
+    std::vector<std::size_t> coverage_begin_;
+
+    const Hypothesis *end_ = NULL;
+
+    std::size_t skipped_edges_ = 0;
 
-    const Hypothesis *end_;
+    Stats stats_;
 };
 
 } // namespace decode
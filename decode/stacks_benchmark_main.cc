@@ -0,0 +1,127 @@
+// Time search on long synthetic sentences drawn from the phrase table's
+// vocabulary.  Reports the average time per sentence to build the chart and
+// to search it.
+#include "decode/chart.hh"
+#include "decode/stacks.hh"
+#include "decode/system.hh"
+#include "decode/vertex_cache.hh"
+#include "decode/weights.hh"
+#include "pt/query.hh"
+#include "pt/statistics.hh"
+#include "util/usage.hh"
+
+// features
+#include "decode/distortion.hh"
+#include "decode/word_insert.hh"
+#include "decode/passthrough.hh"
+#include "decode/phrase_count_feature.hh"
+#include "decode/pt_features.hh"
+#include "decode/lm.hh"
+#include "decode/lexro.hh"
+
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  try {
+    namespace po = boost::program_options;
+    po::options_description options("Search benchmark options");
+    std::string lm_file, phrase_file, weights_file;
+    decode::Config config;
+    std::size_t length, sentences;
+    unsigned int seed;
+    bool dispatch_all;
+
+    options.add_options()
+      ("lm,l", po::value<std::string>(&lm_file)->required(), "Language model file")
+      ("phrase,p", po::value<std::string>(&phrase_file)->required(), "Phrase table")
+      ("weights_file,W", po::value<std::string>(&weights_file)->required(), "Weights file")
+      ("beam,K", po::value<unsigned int>(&config.pop_limit)->default_value(100), "Beam size")
+      ("reordering,R", po::value<std::size_t>(&config.reordering_limit)->default_value(6), "Reordering limit")
+      ("beam_threshold", po::value<float>(&config.beam_threshold), "Only extend hypotheses within this score of the best in their stack")
+      ("coverage_limit", po::value<std::size_t>(&config.coverage_limit)->default_value(0), "Extend at most this many hypotheses per coverage in each stack, 0 for no limit")
+      ("table_limit", po::value<std::size_t>(&config.table_limit)->default_value(0), "Load at most this many target phrases per source phrase, 0 for no limit")
+      ("lazy_lm", po::value<std::size_t>(&config.lazy_lm)->default_value(0), "Language model score only enough target phrases per source phrase to find this many best, 0 for all")
+      ("length", po::value<std::size_t>(&length)->default_value(100), "Words per sentence")
+      ("sentences", po::value<std::size_t>(&sentences)->default_value(10), "Sentences to decode")
+      ("seed", po::value<unsigned int>(&seed)->default_value(1), "Random seed for sentences")
+      ("dispatch_all", po::bool_switch(&dispatch_all), "Call every feature hook, even those a feature leaves empty");
+    if (argc == 1) {
+      std::cerr << options << std::endl;
+      return 1;
+    }
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+
+    pt::Table table(phrase_file.c_str(), util::READ);
+
+    decode::Weights weights;
+    weights.ReadFromFile(weights_file);
+    decode::Distortion distortion;
+    decode::Passthrough passthrough;
+    decode::WordInsertion word_insert;
+    decode::PhraseCountFeature phrase_count_feature;
+    decode::PhraseTableFeatures pt_features;
+    decode::LM lm(lm_file.c_str());
+    decode::LexicalizedReordering lexro;
+
+    decode::System sys(config, table.Accessor(), weights, lm.Model());
+    sys.GetObjective().SetDispatchAll(dispatch_all);
+    sys.GetObjective().AddFeature(distortion);
+    sys.GetObjective().AddFeature(passthrough);
+    sys.GetObjective().AddFeature(word_insert);
+    sys.GetObjective().AddFeature(phrase_count_feature);
+    sys.GetObjective().AddFeature(pt_features);
+    sys.GetObjective().AddFeature(lm);
+    sys.GetObjective().RegisterLanguageModel(lm);
+    sys.GetObjective().AddFeature(lexro);
+    lm.UseTableState(table.Config());
+
+    sys.LoadVocab(table.Vocab(), table.Stats().vocab_size);
+    sys.GetObjective().LoadWeights(weights);
+
+    // Skip <unk> at 0.
+    const decode::BaseVocab &vocab = sys.GetBaseVocab();
+    boost::random::mt19937 gen(seed);
+    boost::random::uniform_int_distribution<std::size_t> word(1, vocab.Size() - 1);
+    std::vector<std::string> input(sentences);
+    for (std::string &sentence : input) {
+      for (std::size_t i = 0; i < length; ++i) {
+        if (i) sentence += ' ';
+        StringPiece str(vocab.String(word(gen)));
+        sentence.append(str.data(), str.size());
+      }
+    }
+
+    decode::VertexCache cache;
+    double chart_time = 0.0, search_time = 0.0;
+    std::size_t skipped_edges = 0;
+    decode::Chart chart(table.Stats().max_source_phrase_length, sys.GetBaseVocab(), sys.GetObjective(), cache, config.table_limit, config.lazy_lm);
+    decode::Stacks stacks;
+    for (const std::string &sentence : input) {
+      double start = util::WallTime();
+      chart.ReadSentence(sentence);
+      chart.LoadPhrases(table);
+      double loaded = util::WallTime();
+      stacks.Decode(sys, chart);
+      search_time += util::WallTime() - loaded;
+      skipped_edges += stacks.SkippedEdges();
+      chart.Clear();
+      chart_time += loaded - start;
+    }
+    std::cout << "Chart " << (chart_time / sentences) << " s/sentence\n"
+      << "Search " << (search_time / sentences) << " s/sentence\n"
+      << "Skipped " << skipped_edges << " edges\n";
+    util::PrintUsage(std::cerr);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "decode/stacks.hh"
+
+#include "decode/hypothesis.hh"
+#include "decode/test_util.hh"
+
+#define BOOST_TEST_MODULE StacksTest
+#include <boost/test/unit_test.hpp>
+
+#include <limits>
+#include <vector>
+
+namespace decode {
+namespace {
+
+// The first survivors of PruneStack, by score.
+std::vector<float> Survivors(const Stack &stack, std::size_t count) {
+  std::vector<float> ret;
+  for (std::size_t i = 0; i < count; ++i) ret.push_back(stack[i]->GetScore());
+  return ret;
+}
+
+class HandStack {
+  public:
+    HandStack() : root_(0.0, NULL),
+      // Two coverages, interleaved.
+      a1_(-1.0, &root_, 0, 1, NULL),
+      b1_(-2.0, &root_, 1, 2, NULL),
+      a2_(-1.5, &root_, 0, 1, NULL),
+      b2_(-3.0, &root_, 1, 2, NULL),
+      a3_(-4.0, &root_, 0, 1, NULL),
+      b3_(-2.5, &root_, 1, 2, NULL) {}
+
+    Stack Get() {
+      Hypothesis *all[] = {&a1_, &b1_, &a2_, &b2_, &a3_, &b3_};
+      return Stack(all, all + 6);
+    }
+
+  private:
+    Hypothesis root_, a1_, b1_, a2_, b2_, a3_, b3_;
+};
+
+Config PruneConfig(float beam_threshold, std::size_t coverage_limit) {
+  Config config(test::TinyConfig());
+  config.beam_threshold = beam_threshold;
+  config.coverage_limit = coverage_limit;
+  return config;
+}
+
+BOOST_AUTO_TEST_CASE(PruneNothing) {
+  HandStack hand;
+  Stack stack(hand.Get());
+  BOOST_CHECK_EQUAL(6, PruneStack(stack, PruneConfig(std::numeric_limits<float>::infinity(), 0)));
+  BOOST_CHECK(stack == hand.Get());
+}
+
+BOOST_AUTO_TEST_CASE(PruneBeam) {
+  HandStack hand;
+  Stack stack(hand.Get());
+  // Within 1 of the best, -1.0, in stack order.
+  std::size_t kept = PruneStack(stack, PruneConfig(1.0, 0));
+  float expected[] = {-1.0, -2.0, -1.5};
+  std::vector<float> survivors(Survivors(stack, kept));
+  BOOST_CHECK_EQUAL_COLLECTIONS(expected, expected + 3, survivors.begin(), survivors.end());
+}
+
+BOOST_AUTO_TEST_CASE(PruneCoverage) {
+  HandStack hand;
+  Stack stack(hand.Get());
+  // The best two of each coverage, in stack order.
+  std::size_t kept = PruneStack(stack, PruneConfig(std::numeric_limits<float>::infinity(), 2));
+  float expected[] = {-1.0, -2.0, -1.5, -2.5};
+  std::vector<float> survivors(Survivors(stack, kept));
+  BOOST_CHECK_EQUAL_COLLECTIONS(expected, expected + 4, survivors.begin(), survivors.end());
+  // Nothing is lost, only moved behind the survivors.
+  BOOST_CHECK_EQUAL(6, stack.size());
+}
+
+BOOST_AUTO_TEST_CASE(PruneBoth) {
+  HandStack hand;
+  Stack stack(hand.Get());
+  // -2.5 is within the coverage limit but outside the beam.
+  std::size_t kept = PruneStack(stack, PruneConfig(1.2, 2));
+  float expected[] = {-1.0, -2.0, -1.5};
+  std::vector<float> survivors(Survivors(stack, kept));
+  BOOST_CHECK_EQUAL_COLLECTIONS(expected, expected + 3, survivors.begin(), survivors.end());
+}
+
+// Decode "a b", where each word has two translations, and return how many
+// edges pruning skipped.
+std::size_t SkippedEdges(float beam_threshold, std::size_t coverage_limit) {
+  // No hypotheses recombine, so each stack after the root holds two.
+  test::TinyDecoder decoder("B2", PruneConfig(beam_threshold, coverage_limit));
+  Translation translation;
+  translation.sequence = 0;
+  decoder.Decode("a b", OutputOptions(), translation);
+  const Stacks &result = decoder.GetStacks();
+  BOOST_REQUIRE(result.End());
+  const std::vector<Stack> &stacks = result.AllStacks();
+  // Root, a, a b, end of sentence.  Pruning does not remove hypotheses.
+  BOOST_REQUIRE_EQUAL(4, stacks.size());
+  BOOST_CHECK_EQUAL(2, stacks[1].size());
+  BOOST_CHECK_EQUAL(2, stacks[2].size());
+  return result.SkippedEdges();
+}
+
+BOOST_AUTO_TEST_CASE(SkippedEdgesCount) {
+  BOOST_CHECK_EQUAL(0, SkippedEdges(std::numeric_limits<float>::infinity(), 0));
+  BOOST_CHECK_EQUAL(0, SkippedEdges(100.0, 0));
+  // The worse of A and A2 is not extended with b, and the worse of the two
+  // complete hypotheses is not extended with </s>.
+  BOOST_CHECK_EQUAL(2, SkippedEdges(0.0, 0));
+  BOOST_CHECK_EQUAL(2, SkippedEdges(std::numeric_limits<float>::infinity(), 1));
+}
+
+} // namespace
+} // namespace decode
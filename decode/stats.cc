@@ -0,0 +1,43 @@
+#include "decode/stats.hh"
+
+#include "util/string_stream.hh"
+
+namespace decode {
+
+void Stats::Add(const Stats &other) {
+  table_lookups += other.table_lookups;
+  table_hits += other.table_hits;
+  cache_lookups += other.cache_lookups;
+  cache_hits += other.cache_hits;
+  spans_pruned += other.spans_pruned;
+  target_phrases += other.target_phrases;
+  lazy_skipped += other.lazy_skipped;
+  edges_pushed += other.edges_pushed;
+  edges_popped += other.edges_popped;
+  hypotheses += other.hypotheses;
+  recombinations += other.recombinations;
+  skipped_edges += other.skipped_edges;
+  chart_seconds += other.chart_seconds;
+  search_seconds += other.search_seconds;
+  output_seconds += other.output_seconds;
+}
+
+void Stats::WriteJSON(util::StringStream &out) const {
+  out << "\"table_lookups\":" << table_lookups
+    << ",\"table_hits\":" << table_hits
+    << ",\"cache_lookups\":" << cache_lookups
+    << ",\"cache_hits\":" << cache_hits
+    << ",\"spans_pruned\":" << spans_pruned
+    << ",\"target_phrases\":" << target_phrases
+    << ",\"lazy_skipped\":" << lazy_skipped
+    << ",\"edges_pushed\":" << edges_pushed
+    << ",\"edges_popped\":" << edges_popped
+    << ",\"hypotheses\":" << hypotheses
+    << ",\"recombinations\":" << recombinations
+    << ",\"skipped_edges\":" << skipped_edges
+    << ",\"chart_seconds\":" << chart_seconds
+    << ",\"search_seconds\":" << search_seconds
+    << ",\"output_seconds\":" << output_seconds;
+}
+
+} // namespace decode
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef DECODE_STATS
+#include "util/usage.hh"
+#endif
+
+namespace util { class StringStream; }
+
+/* Counters and timers for profiling the decoder, reported by decode --stats.
+ * They are compiled in with -DDECODE_STATS (cmake -DDECODE_STATS=ON, the
+ * default).  Without it, DECODE_STATS_ADD and StatsClock do nothing and the
+ * counters stay zero.
+ */
+#ifdef DECODE_STATS
+#define DECODE_STATS_ADD(counter, amount) ((counter) += (amount))
+#else
+#define DECODE_STATS_ADD(counter, amount)
+#endif
+
+namespace decode {
+
+struct Stats {
+  // Chart::LoadPhrases.
+  uint64_t table_lookups = 0;
+  // Lookups that found target phrases.
+  uint64_t table_hits = 0;
+  uint64_t cache_lookups = 0;
+  uint64_t cache_hits = 0;
+  // Spans skipped because no source phrase extends the span one word shorter.
+  uint64_t spans_pruned = 0;
+  // Target phrases scored, each with one lm::ngram::RuleScore.
+  uint64_t target_phrases = 0;
+  // Target phrases Config::lazy_lm left unscored because they could not
+  // rank among the best.
+  uint64_t lazy_skipped = 0;
+
+  // Stacks.
+  uint64_t edges_pushed = 0;
+  uint64_t edges_popped = 0;
+  uint64_t hypotheses = 0;
+  uint64_t recombinations = 0;
+  uint64_t skipped_edges = 0;
+
+  // Wall time in seconds.
+  double chart_seconds = 0.0;
+  double search_seconds = 0.0;
+  double output_seconds = 0.0;
+
+  void Add(const Stats &other);
+
+  // Write the fields as JSON members, without braces.
+  void WriteJSON(util::StringStream &out) const;
+};
+
+// Measures wall time between laps.
+#ifdef DECODE_STATS
+class StatsClock {
+  public:
+    StatsClock() : last_(util::WallTime()) {}
+
+    // Add the time since construction or the last lap to seconds.
+    void Lap(double &seconds) {
+      double now = util::WallTime();
+      seconds += now - last_;
+      last_ = now;
+    }
+
+  private:
+    double last_;
+};
+#else
+class StatsClock {
+  public:
+    void Lap(double &) {}
+};
+#endif
+
+} // namespace decode
@@ -1,7 +1,17 @@
 #include "decode/system.hh"
 
+#include "decode/coverage.hh"
 #include "pt/access.hh"
 #include "pt/format.hh"
+#include "pt/query.hh"
+#include "pt/statistics.hh"
+#include "util/exception.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <errno.h>
 
 namespace decode {
   
@@ -12,7 +22,10 @@ System::System(const Config config, const pt::Access &phrase_access,
   search_context_(search::Config(
         weights.LMWeight(),
         config.pop_limit,
-        search::NBestConfig(1)), lm) {}
+        search::NBestConfig(1)), lm) {
+  UTIL_THROW_IF2(config.reordering_limit > Coverage::kBits, "Reordering limit " << config.reordering_limit
+      << " exceeds the coverage window of " << Coverage::kBits << " words.  Rebuild with a larger DECODE_COVERAGE_BITS.");
+}
 
 void System::LoadWeights() {
   objective_.LoadWeights(weights_);
@@ -27,6 +40,50 @@ void System::LoadVocab(pt::VocabRange vocab_range, std::size_t vocab_size) {
   }
 }
 
+void System::LoadVocab(pt::Table &table, uint64_t lm_checksum, const std::string &baked_file) {
+  const util::Layout &word_layout = objective_.GetFeatureInit().word_layout;
+  UTIL_THROW_IF2(word_layout.OffsetsBegin() != word_layout.OffsetsEnd(), "Words have variable-length fields, which cannot be baked.");
+  const std::size_t word_bytes = word_layout.OffsetsEnd();
+  std::unique_ptr<BakedVocab> baked;
+  try {
+    baked.reset(new BakedVocab(baked_file, util::LAZY));
+  } catch (const util::ErrnoException &e) {
+    // A missing file is baked below; anything else is a real problem.
+    if (e.Error() != ENOENT) throw;
+  } catch (const util::Exception &e) {
+    std::cerr << "Replacing " << baked_file << ": " << e.what() << std::endl;
+  }
+  if (baked && BakedMatches(*baked, table.Fingerprint(), lm_checksum, table.Stats().vocab_size, word_bytes)) {
+    base_vocab_.baked = std::move(baked);
+    return;
+  }
+  baked.reset();
+  LoadVocab(table.Vocab(), table.Stats().vocab_size);
+  try {
+    BakedVocab::Write(base_vocab_, word_bytes, table.Fingerprint(), lm_checksum, baked_file);
+  } catch (const util::Exception &e) {
+    // The vocabulary is loaded, so decode without the baked file.
+    std::cerr << "Could not bake the vocabulary to " << baked_file << ": " << e.what() << std::endl;
+  }
+}
+
+bool System::BakedMatches(const BakedVocab &baked, uint64_t table_fingerprint, uint64_t lm_checksum, std::size_t vocab_size, std::size_t word_bytes) {
+  if (baked.TableFingerprint() != table_fingerprint || baked.LMChecksum() != lm_checksum || baked.Size() != vocab_size || baked.WordBytes() != word_bytes)
+    return false;
+  // Other features may have changed, so remake some words and compare.
+  const std::size_t kSamples = 1024;
+  util::Layout &word_layout = objective_.GetFeatureInit().word_layout;
+  util::Pool pool;
+  const std::size_t step = std::max<std::size_t>(1, vocab_size / kSamples);
+  for (std::size_t id = 0; id < vocab_size; id += step) {
+    VocabWord *fresh = reinterpret_cast<VocabWord*>(word_layout.Allocate(pool));
+    objective_.GetFeatureInit().pt_id_field(fresh) = id;
+    objective_.NewWord(baked.String(id), fresh);
+    if (std::memcmp(fresh, baked.Word(id), word_bytes)) return false;
+  }
+  return true;
+}
+
 void System::InsertNewWord(const ID id) {
   util::Layout &word_layout = objective_.GetFeatureInit().word_layout;
   VocabWord *mapping = reinterpret_cast<VocabWord*>(word_layout.Allocate(base_vocab_.pool));
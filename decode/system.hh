@@ -1,14 +1,20 @@
 #pragma once
 
 #include "lm/model.hh"
+#include "decode/baked_vocab.hh"
 #include "decode/objective.hh"
 #include "decode/weights.hh"
 #include "search/context.hh"
 #include "util/mutable_vocab.hh"
 
+#include <limits>
+#include <memory>
+#include <string>
+
 namespace pt {
   struct VocabRange;
   class Access;
+  class Table;
 }
 
 namespace decode {
@@ -16,17 +22,48 @@ namespace decode {
 struct Config {
   std::size_t reordering_limit;
   unsigned int pop_limit;
+  // Only extend hypotheses scoring within this margin of the best in their
+  // stack.
+  float beam_threshold = std::numeric_limits<float>::infinity();
+  // Extend at most this many hypotheses with the same coverage from each
+  // stack, 0 for no limit.
+  std::size_t coverage_limit = 0;
+  // Load at most this many target phrases for each source phrase, 0 for no
+  // limit.  Tables binarized with weights have the best ones first.
+  std::size_t table_limit = 0;
+  // Score target phrases with the language model in order of their other
+  // features, stopping once the best lazy_lm for each source phrase are
+  // known.  0 scores them all.
+  std::size_t lazy_lm = 0;
 };
 
+// The phrase table's words.  Either built in vocab, map, and pool or, when
+// baked is set, mapped from a file.
 struct BaseVocab {
   util::MutableVocab vocab;
   std::vector<VocabWord*> map;
   util::Pool pool;
 
+  std::unique_ptr<BakedVocab> baked;
+
   std::size_t Size() const {
+    if (baked) return baked->Size();
     assert(vocab.Size() == map.size());
     return map.size();
   }
+
+  // 0 if absent.
+  ID Find(const StringPiece &str) const {
+    return baked ? baked->Find(str) : vocab.Find(str);
+  }
+
+  StringPiece String(ID id) const {
+    return baked ? baked->String(id) : vocab.String(id);
+  }
+
+  VocabWord *Word(ID id) const {
+    return baked ? baked->Word(id) : map[id];
+  }
 };
 
 class System {
@@ -38,6 +75,14 @@ class System {
 
     void LoadVocab(pt::VocabRange vocab, std::size_t vocab_size);
 
+    /* Like LoadVocab, but map the result from baked_file if it was baked for
+     * this table, the language model with lm_checksum, and these features.
+     * Otherwise load the vocabulary from the table and try to bake it to
+     * baked_file for next time, logging to stderr if that fails.  Call after
+     * every feature is added.
+     */
+    void LoadVocab(pt::Table &table, uint64_t lm_checksum, const std::string &baked_file);
+
     const Config &GetConfig() const { return config_; }
 
     const search::Context<lm::ngram::Model> &SearchContext() const {
@@ -51,6 +96,9 @@ class System {
   private:
     void InsertNewWord(const ID id);
 
+    // Whether baked was made for this table and these features.
+    bool BakedMatches(const BakedVocab &baked, uint64_t table_fingerprint, uint64_t lm_checksum, std::size_t vocab_size, std::size_t word_bytes);
+
     Objective objective_;
     const Config config_;
 
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "decode/decode.hh"
+#include "decode/lm.hh"
+#include "decode/pt_features.hh"
+#include "decode/system.hh"
+#include "decode/vertex_cache.hh"
+#include "decode/weights.hh"
+#include "pt/create.hh"
+#include "pt/query.hh"
+#include "pt/statistics.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+#include "util/string_piece.hh"
+
+#include <memory>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/* A complete decoder for tests, small enough to reason about by hand.  The
+ * source words a and b have translations A, A2 and B, B2, scored by one
+ * phrase table feature and a bigram language model.
+ */
+namespace decode {
+namespace test {
+
+// A named temporary file, since the language model and weights are loaded by
+// name.
+class NamedTemp {
+  public:
+    explicit NamedTemp(StringPiece text) : name_(util::DefaultTempDirectory() + "decode_test_XXXXXX") {
+      util::scoped_fd file(mkstemp(&name_[0]));
+      UTIL_THROW_IF(file.get() == -1, util::ErrnoException, "Failed to make a temporary file");
+      util::WriteOrThrow(file.get(), text.data(), text.size());
+    }
+
+    ~NamedTemp() { unlink(name_.c_str()); }
+
+    const char *Name() const { return name_.c_str(); }
+
+  private:
+    std::string name_;
+};
+
+// The language model has bigrams A B, A2 a2_next, B </s>, and B2 </s>, so A
+// and A2 have different states, as do B and B2.
+inline std::string TinyArpa(StringPiece a2_next) {
+  return std::string(
+    "\\data\\\n"
+    "ngram 1=7\n"
+    "ngram 2=4\n"
+    "\n"
+    "\\1-grams:\n"
+    "-1.0\t<unk>\t0\n"
+    "-99\t<s>\t-0.5\n"
+    "-1.0\t</s>\t0\n"
+    "-0.5\tA\t-0.3\n"
+    "-0.7\tA2\t-0.3\n"
+    "-0.6\tB\t-0.2\n"
+    "-0.8\tB2\t-0.2\n"
+    "\n"
+    "\\2-grams:\n"
+    "-0.2\tA B\n"
+    "-0.3\tA2 ") + a2_next.as_string() + "\n"
+    "-0.1\tB </s>\n"
+    "-0.2\tB2 </s>\n"
+    "\n"
+    "\\end\\\n";
+}
+
+// Binarize a phrase table with one dense feature from text.
+inline int TinyTable() {
+  const char text[] =
+    "a ||| A ||| 0.5\n"
+    "a ||| A2 ||| 0.4\n"
+    "b ||| B ||| 0.5\n"
+    "b ||| B2 ||| 0.3\n";
+  util::scoped_fd text_file(util::MakeTemp(util::DefaultTempDirectory()));
+  util::WriteOrThrow(text_file.get(), text, sizeof(text) - 1);
+  util::SeekOrThrow(text_file.get(), 0);
+  util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+  pt::FieldConfig fields;
+  fields.dense_features = 1;
+  pt::CreateTable(text_file.release(), util::DupOrThrow(binary.get()), pt::TextColumns(), fields);
+  util::SeekOrThrow(binary.get(), 0);
+  return binary.release();
+}
+
+// Monotone search with room for every hypothesis.
+inline Config TinyConfig() {
+  Config config;
+  config.reordering_limit = 0;
+  config.pop_limit = 100;
+  return config;
+}
+
+class TinyDecoder {
+  public:
+    TinyDecoder(StringPiece a2_next, const Config &config = TinyConfig())
+      : arpa_(TinyArpa(a2_next)),
+        weights_file_("phrase_table 1\nlm 1\ndistortion -0.3\ntarget_word_insertion -0.1\n"),
+        table_(TinyTable(), util::READ),
+        lm_(arpa_.Name()) {
+      weights_.ReadFromFile(weights_file_.Name());
+      system_.reset(new System(config, table_.Accessor(), weights_, lm_.Model()));
+      system_->GetObjective().AddFeature(pt_features_);
+      system_->GetObjective().AddFeature(lm_);
+      system_->GetObjective().RegisterLanguageModel(lm_);
+      system_->LoadVocab(table_.Vocab(), table_.Stats().vocab_size);
+      system_->GetObjective().LoadWeights(weights_);
+      workspace_.reset(new Workspace(*system_, table_, cache_));
+    }
+
+    void Decode(StringPiece sentence, const OutputOptions &options, Translation &translation) {
+      decode::Decode(*system_, table_, *workspace_, sentence, options, translation);
+    }
+
+    // Search results of the last Decode.
+    const Stacks &GetStacks() const { return workspace_->stacks; }
+
+  private:
+    NamedTemp arpa_, weights_file_;
+    pt::Table table_;
+    LM lm_;
+    Weights weights_;
+    PhraseTableFeatures pt_features_;
+    std::unique_ptr<System> system_;
+    VertexCache cache_;
+    std::unique_ptr<Workspace> workspace_;
+};
+
+} // namespace test
+} // namespace decode
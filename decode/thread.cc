@@ -0,0 +1,113 @@
+#include "decode/thread.hh"
+
+#include "decode/decode.hh"
+#include "decode/system.hh"
+#include "util/file_stream.hh"
+#include "util/numa.hh"
+#include "util/usage.hh"
+
+#include <boost/utility/in_place_factory.hpp>
+
+#include <iostream>
+
+namespace decode {
+
+namespace {
+void Write(util::StringStream &from, util::FileStream *to) {
+  if (to) {
+    *to << from.str();
+    to->flush();
+  }
+  from.str(std::string());
+}
+} // namespace
+
+void WriteTranslation(Translation &translation, const OutputFiles &files) {
+  util::PrintUsage(std::cerr);
+  std::cerr << "sentence " << translation.sequence << '\n' << translation.log.str();
+  if (!translation.error.empty()) {
+    std::cerr << "error: " << translation.error << '\n';
+  }
+  std::cerr << std::flush;
+  translation.log.str(std::string());
+  Write(translation.output, files.out);
+  Write(translation.nbest, files.nbest);
+  Write(translation.lattice, files.lattice);
+  if (files.stats) {
+    util::StringStream line;
+    line << "{\"sentence\":" << translation.sequence << ',';
+    translation.stats.WriteJSON(line);
+    line << "}\n";
+    Write(line, files.stats);
+  }
+  if (files.total) {
+    files.total->Add(translation.stats);
+  }
+}
+
+DecodeWorker::DecodeWorker(const Replica &replica, const OutputOptions &options, util::PCQueue<Request> &done)
+  : system_(*replica.system), table_(*replica.table), options_(options),
+    node_(replica.node), bound_(false),
+    workspace_(*replica.system, *replica.table, *replica.cache), done_(done) {}
+
+DecodeWorker::DecodeWorker(const std::vector<Replica> &replicas, std::size_t &next, const OutputOptions &options, util::PCQueue<Request> &done)
+  : DecodeWorker(replicas[next++ % replicas.size()], options, done) {}
+
+void DecodeWorker::operator()(Request request) {
+  if (!bound_) {
+    if (node_ != Replica::kAnyNode) util::BindToNumaNode(node_);
+    bound_ = true;
+  }
+  // The thread pool aborts on exceptions, so fail only this sentence.
+  TryDecode(system_, table_, workspace_, request->input, options_, *request);
+  done_.Produce(request);
+}
+
+void OutputWorker::operator()(Request request) {
+  assert(request->sequence >= base_sequence_);
+  // Assemble the output in order.
+  uint64_t pos = request->sequence - base_sequence_;
+  if (pos >= ordering_.size()) {
+    ordering_.resize(pos + 1, NULL);
+  }
+  ordering_[pos] = request;
+  while (!ordering_.empty() && ordering_.front()) {
+    WriteTranslation(*ordering_.front(), files_);
+    done_.Produce(ordering_.front());
+    ordering_.pop_front();
+    ++base_sequence_;
+  }
+}
+
+namespace {
+std::vector<Replica> OneReplica(System &system, const pt::Table &table, VertexCache &cache) {
+  Replica replica = {&system, &table, &cache, Replica::kAnyNode};
+  return std::vector<Replica>(1, replica);
+}
+} // namespace
+
+ThreadedDecoder::ThreadedDecoder(System &system, const pt::Table &table, VertexCache &cache, const OutputOptions &options, std::size_t threads, const OutputFiles &files)
+  : ThreadedDecoder(OneReplica(system, table, cache), options, threads, files) {}
+
+ThreadedDecoder::ThreadedDecoder(const std::vector<Replica> &replicas, const OutputOptions &options, std::size_t threads, const OutputFiles &files)
+  // Enough buffers to keep every thread busy while output waits on a slow sentence.
+  : translations_(threads * 4),
+    recycle_(translations_.size()),
+    replicas_(replicas),
+    next_replica_(0),
+    output_(translations_.size(), 1, boost::in_place(boost::cref(files), boost::ref(recycle_)), NULL),
+    decode_(translations_.size(), threads, boost::in_place(boost::cref(replicas_), boost::ref(next_replica_), boost::cref(options), boost::ref(output_.In())), NULL),
+    sequence_(0) {
+  for (Translation &t : translations_) {
+    recycle_.Produce(&t);
+  }
+}
+
+void ThreadedDecoder::Add(StringPiece line) {
+  Translation *translation = recycle_.Consume();
+  translation->sequence = sequence_++;
+  translation->input.assign(line.data(), line.size());
+  decode_.Produce(translation);
+}
+
+} // namespace decode
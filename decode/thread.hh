@@ -0,0 +1,126 @@
+#pragma once
+
+#include "decode/chart.hh"
+#include "decode/decode.hh"
+#include "decode/output.hh"
+#include "util/string_piece.hh"
+#include "util/thread_pool.hh"
+
+#include <deque>
+#include <vector>
+
+#include <stdint.h>
+
+namespace pt { class Table; }
+namespace util { class FileStream; }
+
+/* Sentence-parallel decoding.  One thread reads input and hands sentences to
+ * decoding threads, which share System and the phrase table read-only and
+ * the thread-safe VertexCache.  A single output thread puts the results back
+ * in input order.  With several replicas, e.g. one per NUMA node, threads are
+ * dealt out to them in turn.
+ */
+namespace decode {
+
+class System;
+
+// Where translations are written.  Optional outputs are NULL when disabled.
+struct OutputFiles {
+  util::FileStream *out;
+  util::FileStream *nbest;
+  util::FileStream *lattice;
+  // JSON lines of per-sentence Stats.
+  util::FileStream *stats;
+  // Sum of Stats over the sentences written, if not NULL.
+  Stats *total;
+};
+
+// Write the translation to files and its diagnostics to stderr, then clear
+// them so the Translation can be reused.
+void WriteTranslation(Translation &translation, const OutputFiles &files);
+
+// What a decoding thread reads.
+struct Replica {
+  System *system;
+  const pt::Table *table;
+  VertexCache *cache;
+  // NUMA node to run decoding threads on, or kAnyNode.
+  std::size_t node;
+
+  static const std::size_t kAnyNode = static_cast<std::size_t>(-1);
+};
+
+class DecodeWorker {
+  public:
+    typedef Translation *Request;
+
+    DecodeWorker(const Replica &replica, const OutputOptions &options, util::PCQueue<Request> &done);
+
+    // Workers are constructed one after another, so this takes the replica
+    // for the next one from next.
+    DecodeWorker(const std::vector<Replica> &replicas, std::size_t &next, const OutputOptions &options, util::PCQueue<Request> &done);
+
+    void operator()(Request request);
+
+  private:
+    System &system_;
+    const pt::Table &table_;
+    const OutputOptions options_;
+
+    // Bound on the first request, which runs in the worker's own thread.
+    std::size_t node_;
+    bool bound_;
+
+    Workspace workspace_;
+
+    util::PCQueue<Request> &done_;
+};
+
+// There should only be one OutputWorker.
+class OutputWorker {
+  public:
+    typedef Translation *Request;
+
+    OutputWorker(const OutputFiles &files, util::PCQueue<Request> &done)
+      : files_(files), done_(done), base_sequence_(0) {}
+
+    void operator()(Request request);
+
+  private:
+    const OutputFiles files_;
+
+    util::PCQueue<Request> &done_;
+
+    // Finished translations waiting on an earlier sentence.
+    std::deque<Request> ordering_;
+
+    uint64_t base_sequence_;
+};
+
+class ThreadedDecoder {
+  public:
+    ThreadedDecoder(System &system, const pt::Table &table, VertexCache &cache, const OutputOptions &options, std::size_t threads, const OutputFiles &files);
+
+    ThreadedDecoder(const std::vector<Replica> &replicas, const OutputOptions &options, std::size_t threads, const OutputFiles &files);
+
+    // Queue a sentence for decoding.  Blocks if all buffers are in flight.
+    void Add(StringPiece line);
+
+    // The destructor waits for every queued sentence to be written.
+
+  private:
+    std::vector<Translation> translations_;
+
+    util::PCQueue<Translation*> recycle_;
+
+    std::vector<Replica> replicas_;
+    std::size_t next_replica_;
+
+    // Order matters: decoding threads are joined before the output thread.
+    util::ThreadPool<OutputWorker> output_;
+    util::ThreadPool<DecodeWorker> decode_;
+
+    uint64_t sequence_;
+};
+
+} // namespace decode
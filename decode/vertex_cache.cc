@@ -0,0 +1,89 @@
+#include "decode/vertex_cache.hh"
+
+namespace decode {
+
+VertexCache::VertexCache(const VertexCacheConfig &config)
+  : config_(config), permanent_(false) {}
+
+VertexCache::~VertexCache() {
+  for (Shard &shard : shards_) {
+    for (auto &entry : shard.map) {
+      delete entry.second;
+    }
+  }
+}
+
+VertexCache::Entry *VertexCache::Find(uint64_t hash) {
+  Shard &shard = ShardFor(hash);
+  boost::unique_lock<boost::mutex> lock(shard.mutex);
+  boost::unordered_map<uint64_t, Entry*>::iterator found = shard.map.find(hash);
+  if (found == shard.map.end()) return NULL;
+  Entry *entry = found->second;
+  ++entry->pins_;
+  entry->referenced_ = true;
+  return entry;
+}
+
+VertexCache::Entry *VertexCache::Insert(uint64_t hash, Entry *built, std::size_t phrase_memory) {
+  // Expand outside the lock; this is the expensive part.
+  built->vertex_.Root().BuildExtendAll();
+  built->hash_ = hash;
+  built->memory_ = sizeof(Entry) + phrase_memory + built->vertex_.Root().MemoryUsage();
+  built->pins_ = 1;
+  built->referenced_ = true;
+  built->permanent_ = permanent_;
+
+  Shard &shard = ShardFor(hash);
+  boost::unique_lock<boost::mutex> lock(shard.mutex);
+  std::pair<boost::unordered_map<uint64_t, Entry*>::iterator, bool> res(shard.map.insert(std::make_pair(hash, built)));
+  if (!res.second) {
+    // Another thread got here first.
+    Entry *existing = res.first->second;
+    ++existing->pins_;
+    existing->referenced_ = true;
+    lock.unlock();
+    delete built;
+    return existing;
+  }
+  if (built->permanent_) return built;
+  if (shard.free_slots.empty()) {
+    built->slot_ = shard.ring.size();
+    shard.ring.push_back(built);
+  } else {
+    built->slot_ = shard.free_slots.back();
+    shard.free_slots.pop_back();
+    shard.ring[built->slot_] = built;
+  }
+  shard.memory += built->memory_;
+  Evict(shard);
+  return built;
+}
+
+void VertexCache::Release(Entry *entry) {
+  Shard &shard = ShardFor(entry->hash_);
+  boost::unique_lock<boost::mutex> lock(shard.mutex);
+  assert(entry->pins_);
+  --entry->pins_;
+}
+
+void VertexCache::Evict(Shard &shard) {
+  const std::size_t budget = config_.memory / kShards;
+  // Two sweeps clear every reference bit, so give up after that: everything
+  // left is pinned.
+  for (std::size_t visited = 0; shard.memory > budget && visited < 2 * shard.ring.size(); ++visited) {
+    if (shard.hand >= shard.ring.size()) shard.hand = 0;
+    Entry *&entry = shard.ring[shard.hand++];
+    if (!entry || entry->pins_) continue;
+    if (entry->referenced_) {
+      entry->referenced_ = false;
+      continue;
+    }
+    shard.map.erase(entry->hash_);
+    shard.memory -= entry->memory_;
+    shard.free_slots.push_back(entry->slot_);
+    delete entry;
+    entry = NULL;
+  }
+}
+
+} // namespace decode
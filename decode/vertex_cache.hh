@@ -0,0 +1,116 @@
+#pragma once
+
+#include "search/vertex.hh"
+#include "util/pool.hh"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+/* Scored target phrases for short source phrases, shared by all decoding
+ * threads.  Entries are keyed by pt::HashSource of the source words, like the
+ * phrase table itself.  An entry is fully expanded (BuildExtendAll) before it
+ * is published, so search only ever reads it.
+ *
+ * The cache is split into shards, each with its own lock, hash table, and
+ * CLOCK ring for eviction.  Entries are pinned while a Chart uses them and
+ * pinned entries are never evicted, so memory can exceed the budget by what is
+ * in flight.
+ */
+namespace decode {
+
+struct VertexCacheConfig {
+  // Memory budget in bytes.  This is approximate.
+  std::size_t memory = 1ULL << 30;
+
+  // Only source phrases up to this length are cached.
+  std::size_t max_phrase_length = 2;
+};
+
+class VertexCache {
+  public:
+    class Entry {
+      public:
+        search::Vertex &Vertex() { return vertex_; }
+
+        // Target phrases belonging to this entry must be allocated here.
+        util::Pool &PhrasePool() { return phrase_pool_; }
+
+        // Whether a longer source phrase starts with this one, as the table
+        // reported in pt::SourceLookup.
+        bool Longer() const { return longer_; }
+        void SetLonger(bool longer) { longer_ = longer; }
+
+      private:
+        friend class VertexCache;
+
+        search::Vertex vertex_;
+        util::Pool phrase_pool_;
+
+        uint64_t hash_;
+        std::size_t memory_;
+        // Index in the shard's CLOCK ring.
+        std::size_t slot_;
+        unsigned int pins_;
+        bool referenced_;
+        bool permanent_;
+        bool longer_ = false;
+    };
+
+    explicit VertexCache(const VertexCacheConfig &config = VertexCacheConfig());
+
+    ~VertexCache();
+
+    std::size_t MaxPhraseLength() const { return config_.max_phrase_length; }
+
+    // Find and pin an entry.  Returns NULL if the phrase is not cached.
+    Entry *Find(uint64_t hash);
+
+    /* Publish an entry built by the caller, who passes ownership.
+     * phrase_memory is the amount allocated from built->PhrasePool().
+     * Returns the entry now in the cache, pinned.  If another thread published
+     * the same phrase first, built is deleted and the existing entry returned.
+     */
+    Entry *Insert(uint64_t hash, Entry *built, std::size_t phrase_memory);
+
+    // Unpin an entry returned by Find or Insert.
+    void Release(Entry *entry);
+
+    // While set, inserted entries are never evicted and do not count against
+    // the budget.  Used to prewarm the cache at startup.
+    void SetPermanent(bool permanent) { permanent_ = permanent; }
+
+  private:
+    struct Shard {
+      boost::mutex mutex;
+      boost::unordered_map<uint64_t, Entry*> map;
+      // CLOCK ring.  NULL marks a free slot.
+      std::vector<Entry*> ring;
+      std::vector<std::size_t> free_slots;
+      std::size_t hand = 0;
+      std::size_t memory = 0;
+    };
+
+    static const std::size_t kShards = 64;
+
+    Shard &ShardFor(uint64_t hash) {
+      // The low bits choose the bucket within the shard.
+      return shards_[(hash >> 58) % kShards];
+    }
+
+    // Evict unpinned entries from shard until it fits its budget.  Must hold
+    // the shard's lock.
+    void Evict(Shard &shard);
+
+    const VertexCacheConfig config_;
+
+    bool permanent_;
+
+    Shard shards_[kShards];
+};
+
+} // namespace decode
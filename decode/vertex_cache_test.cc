@@ -0,0 +1,57 @@
+#include "decode/vertex_cache.hh"
+
+#define BOOST_TEST_MODULE VertexCacheTest
+#include <boost/test/unit_test.hpp>
+
+namespace decode {
+namespace {
+
+BOOST_AUTO_TEST_CASE(FindInsert) {
+  VertexCache cache;
+  BOOST_CHECK(!cache.Find(1));
+  VertexCache::Entry *built = new VertexCache::Entry();
+  VertexCache::Entry *entry = cache.Insert(1, built, 0);
+  BOOST_CHECK_EQUAL(built, entry);
+  cache.Release(entry);
+  BOOST_CHECK_EQUAL(entry, cache.Find(1));
+  cache.Release(entry);
+}
+
+BOOST_AUTO_TEST_CASE(Duplicate) {
+  VertexCache cache;
+  VertexCache::Entry *first = cache.Insert(3, new VertexCache::Entry(), 0);
+  VertexCache::Entry *second = cache.Insert(3, new VertexCache::Entry(), 0);
+  BOOST_CHECK_EQUAL(first, second);
+  cache.Release(first);
+  cache.Release(second);
+}
+
+BOOST_AUTO_TEST_CASE(Evict) {
+  VertexCacheConfig config;
+  config.memory = 0;
+  VertexCache cache(config);
+  VertexCache::Entry *pinned = cache.Insert(5, new VertexCache::Entry(), 100);
+  // Pinned entries survive.
+  BOOST_CHECK_EQUAL(pinned, cache.Find(5));
+  cache.Release(pinned);
+  cache.Release(pinned);
+  // Same shard, so inserting evicts the unpinned entry.
+  cache.Release(cache.Insert(6, new VertexCache::Entry(), 100));
+  BOOST_CHECK(!cache.Find(5));
+}
+
+BOOST_AUTO_TEST_CASE(Permanent) {
+  VertexCacheConfig config;
+  config.memory = 0;
+  VertexCache cache(config);
+  cache.SetPermanent(true);
+  cache.Release(cache.Insert(7, new VertexCache::Entry(), 100));
+  cache.SetPermanent(false);
+  cache.Release(cache.Insert(8, new VertexCache::Entry(), 100));
+  VertexCache::Entry *entry = cache.Find(7);
+  BOOST_REQUIRE(entry);
+  cache.Release(entry);
+}
+
+} // namespace
+} // namespace decode
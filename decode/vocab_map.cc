@@ -8,9 +8,9 @@ VocabMap::VocabMap(Objective &objective, const BaseVocab &base)
   : objective_(objective), base_(base), base_size_(base.Size()) {}
 
 VocabWord *VocabMap::FindOrInsert(const StringPiece word, ID &id) {
-  id = base_.vocab.Find(word);
+  id = base_.Find(word);
   if (id > 0) { // word in base vocab
-    return base_.map[id];
+    return base_.Word(id);
   }
   std::size_t local_id = oov_vocab_.FindOrInsert(word);
   id = base_size_ + local_id - 1;
@@ -26,11 +26,17 @@ VocabWord *VocabMap::FindOrInsert(const StringPiece word, ID &id) {
 }
 
 VocabWord *VocabMap::Find(const ID id) const {
-  return id < base_size_ ? base_.map[id] : oov_map_[id - base_.Size()];
+  return id < base_size_ ? base_.Word(id) : oov_map_[id - base_.Size()];
 }
 
 StringPiece VocabMap::String(const ID id) const {
-  return id < base_size_ ? base_.vocab.String(id) : oov_vocab_.String(id - base_.Size() + 1);
+  return id < base_size_ ? base_.String(id) : oov_vocab_.String(id - base_.Size() + 1);
+}
+
+void VocabMap::Clear() {
+  oov_vocab_.Clear();
+  oov_pool_.Reset();
+  oov_map_.clear();
 }
 
 } // namespace decode
@@ -20,6 +20,9 @@ class VocabMap {
 
     StringPiece String(const ID id) const;
 
+    // Forget the oov words, keeping their memory for the next sentence.
+    void Clear();
+
   private:
     const BaseVocab &base_;
     std::size_t base_size_;
@@ -10,6 +10,10 @@ class WordInsertion : public Feature {
   public:
     WordInsertion() : Feature("target_word_insertion") {}
 
+    ScoreMethods UsedScoreMethods() const override {
+      return kScoreTargetPhrase;
+    }
+
     void Init(FeatureInit &feature_init) override {
       UTIL_THROW_IF(!feature_init.phrase_access.target, util::Exception,
           "requested word insertion penalty but target words missing in phrase access");
@@ -1,5 +1,6 @@
 #include "ngram_query.hh"
 #include "../util/getopt.hh"
+#include "../util/numa.hh"
 
 #ifdef WITH_NPLM
 #include "wrappers/nplm.hh"
@@ -16,7 +17,9 @@ void Usage(const char *name) {
     "-v summary|sentence|word: Print statistics at this level.\n"
     "   Can be used multiple times: -v summary -v sentence -v word\n"
     "-l lazy|populate|read|parallel: Load lazily, with populate, or malloc+read\n"
-    "The default loading method is populate on Linux and read on others.\n\n"
+    "The default loading method is populate on Linux and read on others.  read\n"
+    "uses huge pages when the kernel has them.\n"
+    "-N node: Run on this NUMA node and put memory for -l read there.\n\n"
     "Each word in the output is formatted as:\n"
     "  word=vocab_id ngram_length log10(p(word|context))\n"
     "where ngram_length is the length of n-gram matched.  A vocab_id of 0 indicates\n"
@@ -35,9 +38,10 @@ int main(int argc, char *argv[]) {
   bool print_line = false;
   bool print_summary = false;
   bool flush = false;
+  long numa_node = -1;
 
   int opt;
-  while ((opt = getopt(argc, argv, "bnv:l:")) != -1) {
+  while ((opt = getopt(argc, argv, "bnv:l:N:")) != -1) {
     switch (opt) {
       case 'b':
         flush = true;
@@ -81,6 +85,13 @@ int main(int argc, char *argv[]) {
           Usage(argv[0]);
         }
         break;
+      case 'N':
+        {
+          char *end;
+          numa_node = strtol(optarg, &end, 10);
+          if (*end || numa_node < 0) Usage(argv[0]);
+        }
+        break;
       case 'h':
       default:
         Usage(argv[0]);
@@ -97,6 +108,7 @@ int main(int argc, char *argv[]) {
   lm::ngram::QueryPrinter printer(1, print_word, print_line, print_summary, flush);
   const char *file = argv[optind];
   try {
+    if (numa_node >= 0) util::BindToNumaNode(numa_node);
     using namespace lm::ngram;
     ModelType model_type;
     if (RecognizeBinary(file, model_type)) {
@@ -10,8 +10,11 @@ enum FieldLabel {
   DenseFeatures = 1,
   SparseFeatures = 2,
   LexicalReordering = 3,
+  Compact = 4,
+  LMState = 5,
+  LMChecksum = 6,
   // Leave this last.
-  LastLabel = 4,
+  LastLabel = 7,
 };
 
 void Append(FieldLabel label, std::size_t length, util::scoped_memory &mem) {
@@ -61,6 +64,9 @@ void FieldConfig::Save(util::scoped_memory &mem) const {
   Append(DenseFeatures, dense_features, mem);
   Append(SparseFeatures, sparse_features, mem);
   Append(LexicalReordering, lexical_reordering, mem);
+  Append(Compact, compact, mem);
+  Append(LMState, lm_state, mem);
+  Append(LMChecksum, lm_checksum, mem);
 }
 
 void FieldConfig::Restore(const util::scoped_memory &mem) {
@@ -69,6 +75,9 @@ void FieldConfig::Restore(const util::scoped_memory &mem) {
   Consume(DenseFeatures, ptr, mem.end(), dense_features);
   Consume(SparseFeatures, ptr, mem.end(), sparse_features);
   Consume(LexicalReordering, ptr, mem.end(), lexical_reordering);
+  Consume(Compact, ptr, mem.end(), compact);
+  Consume(LMState, ptr, mem.end(), lm_state);
+  Consume(LMChecksum, ptr, mem.end(), lm_checksum);
 }
 
 } // namespace pt
@@ -23,6 +23,14 @@ class FieldConfig {
     std::size_t dense_features = kNotPresent;
     bool sparse_features = false;
     std::size_t lexical_reordering = kNotPresent;
+    // Rows are stored in the format of CompactRows.  Access still describes
+    // rows once they are decoded.
+    bool compact = false;
+    // Each row has language model state, bytes that only the decoder
+    // interprets, made by the language model with lm_checksum.  See
+    // AddLMStates.
+    bool lm_state = false;
+    std::size_t lm_checksum = kNotPresent;
 
     static bool Present(bool value) { return value; }
     static bool Present(std::size_t value) { return value != kNotPresent; }
@@ -75,12 +83,14 @@ class Access {
       target(layout_, config.target),
       dense_features(layout_, config.dense_features),
       sparse_features(layout_, config.sparse_features),
-      lexical_reordering(layout_, config.lexical_reordering) {}
+      lexical_reordering(layout_, config.lexical_reordering),
+      lm_state(layout_, config.lm_state) {}
 
     OptionalField<util::VectorField<WordIndex, VectorSize> > target;
     OptionalField<util::ArrayField<float> > dense_features;
     OptionalField<util::VectorField<SparseFeature, VectorSize> > sparse_features;
     OptionalField<util::ArrayField<float> > lexical_reordering;
+    OptionalField<util::VectorField<uint8_t, VectorSize> > lm_state;
     // TODO word alignment, properties?
 
     // Get the pointer to the next phrase.
@@ -1,10 +1,15 @@
 #include "pt/access.hh"
 #include "pt/create.hh"
+#include "pt/format.hh"
 #include "util/exception.hh"
 #include "util/file.hh"
+#include "util/file_piece.hh"
+#include "util/tokenize_piece.hh"
+#include "util/usage.hh"
 
 #include <boost/program_options.hpp>
 
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -20,6 +25,25 @@ template <class Value> bool Bind(const std::string &col, const char *name, std::
   return true;
 }
 
+// The phrase_table line of a decoder weights file.
+std::vector<float> PhraseTableWeights(const char *file) {
+  util::FilePiece in(file);
+  std::vector<float> ret;
+  for (util::LineIterator line(in.begin()); line; ++line) {
+    util::TokenIter<util::SingleCharacter, true> token(*line, ' ');
+    if (!token || *token != "phrase_table") continue;
+    UTIL_THROW_IF2(!ret.empty(), "Weights file " << file << " has more than one phrase_table line.");
+    while (++token) {
+      char *end;
+      std::string value(token->data(), token->size());
+      ret.push_back(std::strtof(value.c_str(), &end));
+      UTIL_THROW_IF2(*end, "Bad phrase_table weight " << *token << " in " << file);
+    }
+  }
+  UTIL_THROW_IF2(ret.empty(), "No phrase_table weights in " << file);
+  return ret;
+}
+
 } // namespace
 } // namespace pt
 
@@ -44,21 +68,32 @@ int main(int argc, char *argv[]) {
 
     options.add_options()
       ("help,h", po::bool_switch(), "Show this help message")
-      ("columns,c", po::value<std::vector<std::string> >()->multitoken()->default_value(default_columns, default_columns_string), "Columns in the text phrase table.  Use `ignore' to skip a column.");
+      ("columns,c", po::value<std::vector<std::string> >()->multitoken()->default_value(default_columns, default_columns_string), "Columns in the text phrase table.  Use `ignore' to skip a column.")
+      ("threads,t", po::value<std::size_t>()->default_value(1), "Threads parsing text, in addition to a reader and a writer thread")
+      ("output,o", po::value<std::string>(), "Write to this file instead of stdout.  Further shards are named with a suffix .1, .2, etc.")
+      ("shards", po::value<std::size_t>()->default_value(1), "Split the table into this many files by source phrase.  Requires --output.")
+      ("memory,S", po::value<std::string>(), "Sort the source phrase index in this much memory instead of growing it in memory.  Units like lmplz, e.g. 1G or 10%.")
+      ("weights,W", po::value<std::string>(), "Decoder weights file.  Target phrases of each source phrase are sorted best first by the phrase_table weights.")
+      ("table_limit", po::value<std::size_t>()->default_value(0), "Keep this many of the best target phrases for each source phrase, 0 for all.  Requires --weights.")
+      ("compact", po::bool_switch(), "Store word ids as varints and features quantized to 8 bits.  Sparse features are not supported.")
+      ("temp_prefix,T", po::value<std::string>()->default_value(util::DefaultTempDirectory()), "Temporary file prefix for --memory and --compact");
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, options), vm);
 
     bool stdout_is_sizable = true;
-    try {
-      util::SizeOrThrow(1);
-    } catch (const util::FDException &) {
-      stdout_is_sizable = false;
+    if (!vm.count("output")) {
+      try {
+        util::SizeOrThrow(1);
+      } catch (const util::FDException &) {
+        stdout_is_sizable = false;
+      }
     }
 
     if (vm["help"].as<bool>() || !stdout_is_sizable) {
       std::cerr << 
         "Converts a text phrase table to mtplz binary format.\n"
         "Usage: " << argv[0] << " <pt.text >pt.binary\n"
+        "   or: " << argv[0] << " -o pt.binary [--shards N] [-S 1G] [-W weights --table_limit N] [--compact] <pt.text\n"
         "Where pt.binary must be a regular file.\n"
         << options << std::endl;
       return 1;
@@ -83,7 +118,33 @@ int main(int argc, char *argv[]) {
       ++index;
     }
     UTIL_THROW_IF2(!have_source, "Source is a required column.");
-    CreateTable(0, 1, columns, fields);
+
+    CreateConfig create;
+    if (vm.count("memory")) {
+      create.index_memory = util::ParseSize(vm["memory"].as<std::string>());
+    }
+    create.temp_prefix = vm["temp_prefix"].as<std::string>();
+    util::NormalizeTempPrefix(create.temp_prefix);
+    create.threads = vm["threads"].as<std::size_t>();
+    UTIL_THROW_IF2(!create.threads, "Need at least one thread.");
+    create.compact = vm["compact"].as<bool>();
+    if (vm.count("weights")) {
+      create.rank_weights = PhraseTableWeights(vm["weights"].as<std::string>().c_str());
+    }
+    create.table_limit = vm["table_limit"].as<std::size_t>();
+
+    std::size_t shards = vm["shards"].as<std::size_t>();
+    UTIL_THROW_IF2(!shards, "Need at least one shard.");
+    std::vector<int> to;
+    if (vm.count("output")) {
+      for (std::size_t i = 0; i < shards; ++i) {
+        to.push_back(util::CreateOrThrow(ShardFile(vm["output"].as<std::string>(), i).c_str()));
+      }
+    } else {
+      UTIL_THROW_IF2(shards != 1, "Writing shards requires --output.");
+      to.push_back(1);
+    }
+    CreateTable(0, to, columns, fields, create);
   } catch (const std::exception &e) {
     std::cerr << e.what() << std::endl;
     return 1;
@@ -0,0 +1,227 @@
+#include "pt/compact.hh"
+
+#include "pt/access.hh"
+#include "pt/format.hh"
+#include "pt/rewrite.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+#include "util/mmap.hh"
+#include "util/pool.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace pt {
+
+namespace {
+
+std::size_t Columns(std::size_t configured) {
+  return FieldConfig::Present(configured) ? configured : 0;
+}
+
+const uint8_t *ReadVarint(const uint8_t *from, uint64_t &out) {
+  out = 0;
+  for (unsigned shift = 0; ; shift += 7, ++from) {
+    out |= static_cast<uint64_t>(*from & 0x7f) << shift;
+    if (!(*from & 0x80)) return from + 1;
+  }
+}
+
+void WriteVarint(uint64_t value, std::vector<uint8_t> &to) {
+  for (; value >= 0x80; value >>= 7) {
+    to.push_back(static_cast<uint8_t>(value) | 0x80);
+  }
+  to.push_back(static_cast<uint8_t>(value));
+}
+
+// Values kept per column to train its codebook.
+const std::size_t kSample = 1 << 20;
+
+// Reservoir sample of a column's values.  Seeded so tables are reproducible.
+class Sample {
+  public:
+    Sample() : gen_(kSample) {}
+
+    void Add(float value) {
+      if (values_.size() < kSample) {
+        values_.push_back(value);
+      } else {
+        std::uniform_int_distribution<uint64_t> dist(0, seen_);
+        uint64_t replace = dist(gen_);
+        if (replace < kSample) values_[replace] = value;
+      }
+      ++seen_;
+    }
+
+    // Like MakeBins in lm/quantize.cc, but an empty bin repeats its neighbor.
+    void MakeBins(float *centers) {
+      std::sort(values_.begin(), values_.end());
+      std::vector<float>::const_iterator start = values_.begin(), finish;
+      for (std::size_t i = 0; i < CompactRows::kBins; ++i, start = finish) {
+        finish = values_.begin() + (values_.size() * (i + 1)) / CompactRows::kBins;
+        if (finish == start) {
+          centers[i] = i ? centers[i - 1] : (values_.empty() ? 0.0 : values_.front());
+        } else {
+          centers[i] = std::accumulate(start, finish, 0.0) / static_cast<float>(finish - start);
+        }
+      }
+    }
+
+  private:
+    std::vector<float> values_;
+    uint64_t seen_ = 0;
+    std::mt19937_64 gen_;
+};
+
+uint8_t EncodeFeature(const float *centers, float value) {
+  const float *end = centers + CompactRows::kBins;
+  const float *above = std::lower_bound(centers, end, value);
+  if (above == centers) return 0;
+  if (above == end) return CompactRows::kBins - 1;
+  return (value - *(above - 1) < *above - value) ? (above - 1 - centers) : (above - centers);
+}
+
+class Trainer {
+  public:
+    Trainer(const Access &access, std::size_t columns) : access_(access), samples_(columns) {}
+
+    void StartBundle(uint64_t, RowCount) {}
+
+    void AddRow(const Row *row) {
+      std::vector<Sample>::iterator sample = samples_.begin();
+      if (access_.dense_features) {
+        for (float value : access_.dense_features(row)) (sample++)->Add(value);
+      }
+      if (access_.lexical_reordering) {
+        for (float value : access_.lexical_reordering(row)) (sample++)->Add(value);
+      }
+    }
+
+    void MakeBins(util::scoped_memory &to) {
+      util::HugeRealloc(samples_.size() * CompactRows::kBins * sizeof(float), false, to);
+      float *centers = reinterpret_cast<float*>(to.get());
+      for (Sample &sample : samples_) {
+        sample.MakeBins(centers);
+        centers += CompactRows::kBins;
+      }
+    }
+
+  private:
+    const Access &access_;
+    std::vector<Sample> samples_;
+};
+
+class Encoder : public BundleWriter {
+  public:
+    Encoder(const Access &access, const util::scoped_memory &codebooks, FileFormat &out)
+      : BundleWriter(out), access_(access), codebooks_(reinterpret_cast<const float*>(codebooks.get())) {}
+
+    void AddRow(const Row *row) {
+      WriteVarint(access_.target(row).size(), buffer_);
+      for (WordIndex word : access_.target(row)) {
+        WriteVarint(word, buffer_);
+      }
+      const float *centers = codebooks_;
+      if (access_.dense_features) {
+        for (float value : access_.dense_features(row)) {
+          buffer_.push_back(EncodeFeature(centers, value));
+          centers += CompactRows::kBins;
+        }
+      }
+      if (access_.lexical_reordering) {
+        for (float value : access_.lexical_reordering(row)) {
+          buffer_.push_back(EncodeFeature(centers, value));
+          centers += CompactRows::kBins;
+        }
+      }
+    }
+
+  private:
+    const Access &access_;
+    const float *codebooks_;
+};
+
+} // namespace
+
+CompactRows::CompactRows(const FieldConfig &config, const util::scoped_memory &codebooks)
+  : access_(config),
+    dense_features_(Columns(config.dense_features)),
+    lexical_reordering_(Columns(config.lexical_reordering)),
+    codebooks_(reinterpret_cast<const float*>(codebooks.get())) {
+  UTIL_THROW_IF2(codebooks.size() < (dense_features_ + lexical_reordering_) * kBins * sizeof(float), "Compact phrase table has " << codebooks.size() << " bytes of codebooks, too few for " << (dense_features_ + lexical_reordering_) << " columns");
+}
+
+const Row *CompactRows::End(const Row *row) const {
+  const uint8_t *ptr = reinterpret_cast<const uint8_t*>(row);
+  uint64_t words, word;
+  ptr = ReadVarint(ptr, words);
+  for (uint64_t i = 0; i < words; ++i) {
+    ptr = ReadVarint(ptr, word);
+  }
+  return reinterpret_cast<const Row*>(ptr + dense_features_ + lexical_reordering_);
+}
+
+const Row *CompactRows::Decode(const Row *row, util::Pool &pool) {
+  const uint8_t *ptr = reinterpret_cast<const uint8_t*>(row);
+  Row *ret = access_.Allocate(pool);
+  uint64_t words, word;
+  ptr = ReadVarint(ptr, words);
+  util::VectorField<WordIndex, VectorSize>::FakeVector<util::Pool> target(access_.target(ret, pool));
+  target.resize(words);
+  for (uint64_t i = 0; i < words; ++i) {
+    ptr = ReadVarint(ptr, word);
+    target[i] = word;
+  }
+  const float *centers = codebooks_;
+  if (access_.dense_features) {
+    for (float &value : access_.dense_features(ret)) {
+      value = centers[*ptr++];
+      centers += kBins;
+    }
+  }
+  if (access_.lexical_reordering) {
+    for (float &value : access_.lexical_reordering(ret)) {
+      value = centers[*ptr++];
+      centers += kBins;
+    }
+  }
+  return ret;
+}
+
+void CompactTable(int from, int to) {
+  FileFormat in(from, kFileHeader, false, util::LAZY);
+  const util::scoped_memory &rows = in.Attach();
+  const util::scoped_memory &stats = in.Attach();
+  FieldConfig config;
+  config.Restore(in.Attach());
+  UTIL_THROW_IF2(config.compact, "The phrase table is already compact.");
+  UTIL_THROW_IF2(config.sparse_features, "Compact phrase tables do not support sparse features.");
+  UTIL_THROW_IF2(config.lm_state, "Compact phrase tables do not support language model state.");
+  const util::scoped_memory &offsets = in.Attach();
+  Access access(config);
+
+  FileFormat out(to, kFileHeader, true, util::POPULATE_OR_READ /* does not matter since this is the reading method */);
+  CopyRegion(stats, out.Attach());
+  config.compact = true;
+  config.Save(out.Attach());
+  util::scoped_memory &codebooks = out.Attach();
+
+  Trainer trainer(access, Columns(config.dense_features) + Columns(config.lexical_reordering));
+  ForEachBundle(rows, access, trainer);
+  trainer.MakeBins(codebooks);
+
+  Encoder encoder(access, codebooks, out);
+  ForEachBundle(rows, access, encoder);
+  encoder.Flush();
+
+  RemappedOffsets remapped(offsets, encoder);
+  out.AttachStreamed(remapped);
+
+  CopyVocab(in, out);
+  out.Write();
+}
+
+} // namespace pt
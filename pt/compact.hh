@@ -0,0 +1,46 @@
+#pragma once
+
+#include "pt/access.hh"
+#include "pt/types.hh"
+
+#include <cstddef>
+
+namespace util { class Pool; class scoped_memory; }
+
+namespace pt {
+
+/* Rows of tables with FieldConfig::compact set.  A compact row is
+ *   varint count of target words
+ *   varint target word ids
+ *   one byte per dense feature
+ *   one byte per lexical reordering feature
+ * Each feature column has a codebook of kBins centers, trained like
+ * lm/quantize.hh by splitting sorted values into bins of equal count.  The
+ * codebooks are a region right after the FieldConfig.  Sparse features are
+ * not supported.
+ */
+class CompactRows {
+  public:
+    static const std::size_t kBins = 256;
+
+    CompactRows(const FieldConfig &config, const util::scoped_memory &codebooks);
+
+    // The compact row after row.
+    const Row *End(const Row *row) const;
+
+    // Decode into the layout of Access for the same config, allocating from
+    // pool.
+    const Row *Decode(const Row *row, util::Pool &pool);
+
+  private:
+    Access access_;
+    std::size_t dense_features_, lexical_reordering_;
+    // Dense feature columns then lexical reordering columns.
+    const float *codebooks_;
+};
+
+// Rewrite a table written by CreateTable with compact rows.  Takes ownership
+// of from and to.
+void CompactTable(int from, int to);
+
+} // namespace pt
@@ -1,10 +1,12 @@
 #include "pt/create.hh"
 
 #include "pt/access.hh"
+#include "pt/compact.hh"
 #include "pt/format.hh"
 #include "pt/hash.hh"
 #include "pt/hash_table_region.hh"
 #include "pt/record_writer.hh"
+#include "pt/spilling_hash_table_region.hh"
 #include "pt/statistics.hh"
 #include "pt/word_array.hh"
 
@@ -13,10 +15,16 @@
 #include "util/double-conversion/double-conversion.h"
 #include "util/file_piece.hh"
 #include "util/murmur_hash.hh"
+#include "util/stream/chain.hh"
 #include "util/tokenize_piece.hh"
 
 #include <cmath>
 #include <algorithm>
+#include <memory>
+#include <numeric>
+
+#include <cassert>
+#include <cstring>
 
 namespace pt {
 
@@ -28,25 +36,23 @@ void CountColumns(StringPiece part, std::size_t &count) {
   for (util::TokenIter<util::BoolCharacter, true> i(part); i; ++i, ++count) {}
 }
 
+struct ParsedWord;
+
 class SourceHasher {
   public:
     explicit SourceHasher(util::GrowableVocab<WordArray> &vocab) : vocab_(vocab) {}
 
-    uint64_t operator()(StringPiece source) {
-      for (util::TokenIter<util::BoolCharacter, true> i(source); i; ++i) {
-        reuse_.push_back(vocab_.FindOrInsert(*i));
-      }
-      max_source_phrase_length_ = std::max<uint64_t>(max_source_phrase_length_, reuse_.size());
-      uint64_t ret = HashSource(&*reuse_.begin(), &*reuse_.begin() + reuse_.size());
-      reuse_.clear();
-      return ret;
-    }
+    // Words of a ParsedLines block starting at base.
+    uint64_t operator()(const ParsedWord *begin, const ParsedWord *end, const char *base);
 
     uint64_t MaxSourcePhraseLength() const { return max_source_phrase_length_; }
 
+    // Hashes of the proper prefixes of the last phrase hashed, shortest first.
+    const std::vector<uint64_t> &Prefixes() const { return prefixes_; }
+
   private:
     util::GrowableVocab<WordArray> &vocab_;
-    std::vector<WordIndex> reuse_;
+    std::vector<uint64_t> prefixes_;
     uint64_t max_source_phrase_length_ = 0;
 };
 
@@ -69,11 +75,9 @@ struct FloatIdentity {
   float operator()(float in) const { return in; }
 };
 
-template <class Transform> void ParseFloats(StringPiece from, OptionalField<util::ArrayField<float> > &field, Row *row, const Transform &op) {
-  if (!field) return;
+template <class Transform> float *ParseFloats(StringPiece from, float *to, float *const end, const Transform &op) {
+  const std::size_t count = end - to;
   util::TokenIter<util::BoolCharacter, true> token(from);
-  float *to = field(row).begin();
-  float *const end = field(row).end();
   for (; to != end; ++to, ++token) {
     int processed;
     *to = kConverter.StringToFloat(token->data(), token->size(), &processed);
@@ -82,12 +86,331 @@ template <class Transform> void ParseFloats(StringPiece from, OptionalField<util
     *to = op(*to);
     UTIL_THROW_IF2(processed != token->size(), "Did not process full float for " << *token);
   }
-  UTIL_THROW_IF2(token, "More than " << field(row).size() << " floats in " << from);
+  UTIL_THROW_IF2(token, "More than " << count << " floats in " << from);
+  return to;
+}
+
+/* Text is parsed in a util::stream chain:
+ *   ReadLines >> ParseLines (once per thread) >> ParsedLines in CreateTable.
+ * A block has a BlockHeader, whole lines of text, then those lines parsed.
+ * Parsers take turns on blocks, so blocks stay in order.  Parsers tokenize,
+ * hash words, and convert floats; vocabulary ids depend on order so they are
+ * assigned by the writer.
+ */
+struct BlockHeader {
+  // Bytes of text after the header.
+  uint64_t text_size;
+  // Where the parsed lines start, relative to the block.
+  uint64_t parsed_offset;
+  uint64_t lines;
+};
+
+/* A parsed line is a ParsedLine followed by source then target ParsedWords
+ * then dense features then lexical reordering features, padded to 8 bytes.
+ */
+struct ParsedLine {
+  uint32_t source_words;
+  uint32_t target_words;
+};
+
+struct ParsedWord {
+  uint64_t hash;
+  // Relative to the block.
+  uint32_t offset;
+  uint32_t length;
+};
+
+uint64_t SourceHasher::operator()(const ParsedWord *begin, const ParsedWord *end, const char *base) {
+  max_source_phrase_length_ = std::max<uint64_t>(max_source_phrase_length_, end - begin);
+  prefixes_.clear();
+  uint64_t ret = kSourceHashSeed;
+  for (const ParsedWord *i = begin; i != end; ++i) {
+    if (i != begin) prefixes_.push_back(ret);
+    ret = HashExtend(ret, vocab_.FindOrInsert(StringPiece(base + i->offset, i->length), i->hash));
+  }
+  return ret;
+}
+
+const std::size_t kParseBlockSize = 1 << 22;
+
+inline std::size_t AlignParsed(std::size_t offset) {
+  return (offset + 7) & ~static_cast<std::size_t>(7);
 }
 
+/* Every word or float is at least one character and a delimiter, and a line
+ * has at least the 4 characters "|||\n".  So a line of n bytes parses to at
+ * most 8 + 16 * n / 2 + 4 bytes of padding <= 11 * n bytes.  Leave room for
+ * that and for aligning the start of the parsed lines.
+ */
+std::size_t TextCapacity(std::size_t block_size) {
+  return (block_size - sizeof(BlockHeader) - 8) / 12;
+}
+
+std::size_t FloatCount(std::size_t configured) {
+  return FieldConfig::Present(configured) ? configured : 0;
+}
+
+class ReadLines {
+  public:
+    // line has been read but not consumed.
+    explicit ReadLines(util::LineIterator line) : line_(line) {}
+
+    void Run(const util::stream::ChainPosition &position) {
+      const std::size_t capacity = TextCapacity(position.GetChain().BlockSize());
+      for (util::stream::Link block(position); ; ++block) {
+        char *const begin = static_cast<char*>(block->Get()) + sizeof(BlockHeader);
+        char *to = begin;
+        for (; line_; ++line_) {
+          UTIL_THROW_IF2(line_->size() + 1 > capacity, "Line is longer than " << capacity << " bytes: " << *line_);
+          if (to + line_->size() + 1 > begin + capacity) break;
+          std::memcpy(to, line_->data(), line_->size());
+          to += line_->size();
+          *to++ = '\n';
+        }
+        if (to == begin) {
+          block.Poison();
+          return;
+        }
+        static_cast<BlockHeader*>(block->Get())->text_size = to - begin;
+        block->SetValidSize(to - begin);
+      }
+    }
+
+  private:
+    util::LineIterator line_;
+};
+
+class ParseLines {
+  public:
+    // Parse every stride-th block starting with index.
+    ParseLines(std::size_t index, std::size_t stride, std::size_t fields, const TextColumns &columns, const FieldConfig &config)
+      : index_(index), stride_(stride), fields_(fields), columns_(columns),
+        dense_features_(FloatCount(config.dense_features)),
+        lexical_reordering_(FloatCount(config.lexical_reordering)) {}
+
+    void Run(const util::stream::ChainPosition &position) {
+      std::vector<StringPiece> fields(fields_);
+      std::size_t count = 0;
+      for (util::stream::Link block(position); block; ++block, ++count) {
+        if (count % stride_ == index_) Parse(static_cast<char*>(block->Get()), position.GetChain().BlockSize(), fields);
+      }
+    }
+
+  private:
+    void Parse(char *base, std::size_t block_size, std::vector<StringPiece> &fields) const {
+      BlockHeader &header = *reinterpret_cast<BlockHeader*>(base);
+      const char *text = base + sizeof(BlockHeader);
+      const char *const text_end = text + header.text_size;
+      header.parsed_offset = AlignParsed(sizeof(BlockHeader) + header.text_size);
+      header.lines = 0;
+      char *out = base + header.parsed_offset;
+      for (const char *newline; text != text_end; text = newline + 1, ++header.lines) {
+        newline = static_cast<const char*>(std::memchr(text, '\n', text_end - text));
+        StringPiece line(text, newline - text);
+        assert(out + 11 * (line.size() + 1) <= base + block_size);
+        ExtractLine(line, fields);
+        ParsedLine &parsed = *reinterpret_cast<ParsedLine*>(out);
+        ParsedWord *word = reinterpret_cast<ParsedWord*>(out + sizeof(ParsedLine));
+        ParsedWord *const source_end = Words(fields[columns_.source], base, word);
+        parsed.source_words = source_end - word;
+        ParsedWord *const target_end = Words(fields[columns_.target], base, source_end);
+        parsed.target_words = target_end - source_end;
+        float *floats = reinterpret_cast<float*>(target_end);
+        if (dense_features_) {
+          floats = ParseFloats(fields[columns_.dense_features], floats, floats + dense_features_, TakeLogAndMosesFloor());
+        }
+        if (lexical_reordering_) {
+          floats = ParseFloats(fields[columns_.lexical_reordering], floats, floats + lexical_reordering_, TakeLogAndMosesFloor());
+        }
+        // TODO sparse features
+        out = base + AlignParsed(reinterpret_cast<char*>(floats) - base);
+      }
+    }
+
+    static ParsedWord *Words(StringPiece from, const char *base, ParsedWord *to) {
+      for (util::TokenIter<util::BoolCharacter, true> t(from); t; ++t, ++to) {
+        to->hash = util::GrowableVocab<WordArray>::Hash(*t);
+        to->offset = t->data() - base;
+        to->length = t->size();
+      }
+      return to;
+    }
+
+    std::size_t index_, stride_;
+    std::size_t fields_;
+    TextColumns columns_;
+    std::size_t dense_features_, lexical_reordering_;
+};
+
+// Walks the parsed lines at the end of the chain, across blocks.
+class ParsedLines {
+  public:
+    ParsedLines(const util::stream::ChainPosition &position, const FieldConfig &config)
+      : block_(position),
+        dense_features_(FloatCount(config.dense_features)),
+        lexical_reordering_(FloatCount(config.lexical_reordering)) {
+      StartBlock();
+    }
+
+    operator bool() const { return block_; }
+
+    ParsedLines &operator++() {
+      if (--remaining_) {
+        current_ = Base() + AlignParsed(reinterpret_cast<const char*>(LexicalReordering() + lexical_reordering_) - Base());
+      } else {
+        ++block_;
+        StartBlock();
+      }
+      return *this;
+    }
+
+    const char *Base() const { return static_cast<const char*>(block_->Get()); }
+
+    const ParsedWord *SourceBegin() const { return reinterpret_cast<const ParsedWord*>(current_ + sizeof(ParsedLine)); }
+    const ParsedWord *SourceEnd() const { return SourceBegin() + Line().source_words; }
+    const ParsedWord *TargetEnd() const { return SourceEnd() + Line().target_words; }
+
+    const float *DenseFeatures() const { return reinterpret_cast<const float*>(TargetEnd()); }
+    const float *LexicalReordering() const { return DenseFeatures() + dense_features_; }
+
+  private:
+    const ParsedLine &Line() const { return *reinterpret_cast<const ParsedLine*>(current_); }
+
+    void StartBlock() {
+      if (!block_) return;
+      const BlockHeader &header = *static_cast<const BlockHeader*>(block_->Get());
+      assert(header.lines);
+      current_ = Base() + header.parsed_offset;
+      remaining_ = header.lines;
+    }
+
+    util::stream::Link block_;
+    const char *current_;
+    uint64_t remaining_;
+    const std::size_t dense_features_, lexical_reordering_;
+};
+
+// Sorts and prunes the target phrases of a source phrase before they are
+// written.
+class BundleRanker {
+  public:
+    BundleRanker(const Access &access, const CreateConfig &create)
+      : access_(access), weights_(create.rank_weights), limit_(create.table_limit) {}
+
+    void operator()(TargetBundleWriter &bundle) {
+      if (weights_.empty()) return;
+      rows_.clear();
+      const Row *row = reinterpret_cast<const Row*>(bundle.RowsBegin());
+      for (RowCount i = 0; i < bundle.Count(); ++i) {
+        Ranked ranked;
+        ranked.begin = reinterpret_cast<const char*>(row);
+        ranked.score = std::inner_product(weights_.begin(), weights_.end(), access_.dense_features(row).begin(), 0.0f);
+        row = access_.End(row);
+        ranked.end = reinterpret_cast<const char*>(row);
+        rows_.push_back(ranked);
+      }
+      // Stable so ties keep the order of the text.
+      std::stable_sort(rows_.begin(), rows_.end(), [](const Ranked &a, const Ranked &b) { return a.score > b.score; });
+      if (limit_ && rows_.size() > limit_) rows_.resize(limit_);
+      sorted_.clear();
+      for (const Ranked &ranked : rows_) {
+        sorted_.insert(sorted_.end(), ranked.begin, ranked.end);
+      }
+      std::copy(sorted_.begin(), sorted_.end(), bundle.RowsBegin());
+      bundle.Truncate(bundle.RowsBegin() + sorted_.size(), rows_.size());
+    }
+
+  private:
+    struct Ranked {
+      const char *begin, *end;
+      float score;
+    };
+
+    const Access &access_;
+    const std::vector<float> weights_;
+    const std::size_t limit_;
+
+    std::vector<Ranked> rows_;
+    std::vector<char> sorted_;
+};
+
+// One output file with its own target phrases and source phrase index.
+class Shard {
+  public:
+    // The caller attaches the vocabulary region last.
+    Shard(int fd, const FieldConfig &config, const CreateConfig &create, std::size_t shards)
+      : compact_to_(create.compact ? fd : -1),
+        raw_(create.compact ? util::MakeTemp(create.temp_prefix) : -1),
+        file_(create.compact ? util::DupOrThrow(raw_.get()) : fd, kFileHeader, true, util::POPULATE_OR_READ /* does not matter since this is the reading method */),
+        stats_mem_(file_.Attach()),
+        target_write_(file_) {
+      util::HugeRealloc(sizeof(Statistics), false, stats_mem_);
+      Stats().shards = shards;
+      config.Save(file_.Attach());
+      if (create.index_memory) {
+        spilled_offsets_.reset(new SpillingHashTableRegion<uint64_t, CombineIndex>(file_, create.index_memory / shards, create.temp_prefix));
+      } else {
+        offsets_.reset(new HashTableRegion<uint64_t>(file_));
+      }
+    }
+
+    FileFormat &File() { return file_; }
+
+    Statistics &Stats() { return *reinterpret_cast<Statistics*>(stats_mem_.get()); }
+
+    // Index a new source phrase, whose targets will be written next.
+    TargetWriter &StartSource(uint64_t source_hash) {
+      Index(source_hash, target_write_.Offset());
+      return target_write_;
+    }
+
+    // Index a proper prefix of a source phrase.
+    void AddPrefix(uint64_t prefix_hash) {
+      Index(prefix_hash, kIndexLonger | kIndexNoRows);
+    }
+
+    void Write() {
+      if (spilled_offsets_) spilled_offsets_->Finish();
+      file_.Write();
+      if (compact_to_.get() != -1) {
+        util::SeekOrThrow(raw_.get(), 0);
+        CompactTable(raw_.release(), compact_to_.release());
+      }
+    }
+
+  private:
+    void Index(uint64_t hash, uint64_t value) {
+      if (offsets_) {
+        offsets_->InsertOrCombine(hash, value, CombineIndex());
+      } else {
+        spilled_offsets_->Insert(hash, value);
+      }
+    }
+
+    // When compacting, file_ is a temporary raw table to be rewritten to
+    // compact_to_.
+    util::scoped_fd compact_to_, raw_;
+    FileFormat file_;
+    util::scoped_memory &stats_mem_;
+    TargetWriter target_write_;
+    std::unique_ptr<HashTableRegion<uint64_t> > offsets_;
+    std::unique_ptr<SpillingHashTableRegion<uint64_t, CombineIndex> > spilled_offsets_;
+};
+
 } // namespace
 
-void CreateTable(int from, int to, const TextColumns columns, FieldConfig &config) {
+void CreateTable(int from, int to, const TextColumns columns, FieldConfig &config, const CreateConfig &create) {
+  CreateTable(from, std::vector<int>(1, to), columns, config, create);
+}
+
+void CreateTable(int from, const std::vector<int> &to, const TextColumns columns, FieldConfig &config, const CreateConfig &create) {
+  std::vector<util::scoped_fd> to_owned;
+  for (int fd : to) {
+    to_owned.emplace_back(fd);
+  }
+  UTIL_THROW_IF2(to.empty(), "No files to write the phrase table to.");
+  UTIL_THROW_IF2(create.compact && config.sparse_features, "Compact phrase tables do not support sparse features.");
+  UTIL_THROW_IF2(create.table_limit && create.rank_weights.empty(), "A table limit needs weights to rank target phrases by.");
   util::FilePiece f(from, NULL, &std::cerr);
   util::LineIterator line = f.begin();
   UTIL_THROW_IF2(!line, "Empty phrase table file");
@@ -101,7 +424,6 @@ void CreateTable(int from, int to, const TextColumns columns, FieldConfig &confi
   const std::size_t have_fields = parsed_line.size();
 
   UTIL_THROW_IF2(columns.source >= have_fields, "Text file has columns [0, " << have_fields << ") but the source is supposed to be in column " << columns.source);
-  StringPiece &source = parsed_line[columns.source];
 #define BIND_COLUMN(name) \
   UTIL_THROW_IF2(FieldConfig::Present(config.name) && columns.name >= have_fields, "Text file has columns [0, " << have_fields << ") but " #name  " is supposed to be in column " << columns.name); \
   StringPiece &name = parsed_line[FieldConfig::Present(config.name) ? columns.name : 0];
@@ -115,46 +437,75 @@ void CreateTable(int from, int to, const TextColumns columns, FieldConfig &confi
   CountColumns(dense_features, config.dense_features);
   CountColumns(lexical_reordering, config.lexical_reordering);
   // Now we have a fully-configured set of columns.
+  UTIL_THROW_IF2(!create.rank_weights.empty() && create.rank_weights.size() != FloatCount(config.dense_features), "There are " << create.rank_weights.size() << " weights to rank target phrases but the table has " << FloatCount(config.dense_features) << " dense features.");
 
-  FileFormat file(to, kFileHeader, true, util::POPULATE_OR_READ /* does not matter since this is the reading method */);
-  util::scoped_memory &stats_mem = file.Attach();
-  util::HugeRealloc(sizeof(Statistics), false, stats_mem);
-  Statistics &stats = *reinterpret_cast<Statistics*>(stats_mem.get());
-  TargetWriter target_write(file);
-  config.Save(file.Attach());
-  HashTableRegion<uint64_t> offsets(file);
-  util::GrowableVocab<WordArray> vocab(100, file);
+  std::vector<std::unique_ptr<Shard> > shards;
+  for (util::scoped_fd &fd : to_owned) {
+    shards.emplace_back(new Shard(fd.release(), config, create, to.size()));
+  }
+  // Only the first shard has the vocabulary.
+  util::GrowableVocab<WordArray> vocab(100, shards.front()->File());
+  for (std::size_t i = 1; i < shards.size(); ++i) {
+    shards[i]->File().Attach();
+  }
   SourceHasher source_hasher(vocab);
   Access access(config);
+  BundleRanker rank(access, create);
 
   UTIL_THROW_IF2(!access.target, "Refusing to create a phrase table without target words.");
 
-  uint64_t source_hash = source_hasher(source), new_source_hash;
-  while (line) {
-    offsets.Insert(source_hash, target_write.Offset());
-    TargetBundleWriter bundle(target_write);
+  const std::size_t threads = std::max<std::size_t>(1, create.threads);
+  const std::size_t blocks = 2 * threads + 2;
+  util::stream::Chain chain(util::stream::ChainConfig(1, blocks, blocks * kParseBlockSize));
+  chain >> ReadLines(line);
+  for (std::size_t i = 0; i < threads; ++i) {
+    chain >> ParseLines(i, threads, have_fields, columns, config);
+  }
+  util::stream::ChainPosition writer(chain.Add());
+  chain >> util::stream::kRecycle;
+  ParsedLines parsed(writer, config);
+
+  uint64_t source_hash = source_hasher(parsed.SourceBegin(), parsed.SourceEnd(), parsed.Base()), new_source_hash;
+  // Prefixes of the last source phrase, which were already indexed.  Text
+  // sorted by source repeats them a lot.
+  std::vector<uint64_t> indexed_prefixes;
+  while (parsed) {
+    const std::vector<uint64_t> &prefixes = source_hasher.Prefixes();
+    std::size_t same = 0;
+    // Prefixes are chained, so once one differs the longer ones do too.
+    while (same < prefixes.size() && same < indexed_prefixes.size() && prefixes[same] == indexed_prefixes[same]) ++same;
+    for (std::size_t i = same; i < prefixes.size(); ++i) {
+      shards[ShardOf(prefixes[i], shards.size())]->AddPrefix(prefixes[i]);
+    }
+    indexed_prefixes = prefixes;
+    TargetBundleWriter bundle(shards[ShardOf(source_hash, shards.size())]->StartSource(source_hash));
     do {
       Row *row = access.Allocate(bundle);
 
       // Fill target.
       util::VectorField<WordIndex, VectorSize>::FakeVector<TargetBundleWriter> vec = access.target(row, bundle);
-      for (util::TokenIter<util::BoolCharacter, true> t(target); t; ++t) {
-        vec.push_back(vocab.FindOrInsert(*t));
+      for (const ParsedWord *t = parsed.SourceEnd(); t != parsed.TargetEnd(); ++t) {
+        vec.push_back(vocab.FindOrInsert(StringPiece(parsed.Base() + t->offset, t->length), t->hash));
+      }
+      if (access.dense_features) {
+        std::copy(parsed.DenseFeatures(), parsed.DenseFeatures() + config.dense_features, access.dense_features(row).begin());
+      }
+      if (access.lexical_reordering) {
+        std::copy(parsed.LexicalReordering(), parsed.LexicalReordering() + config.lexical_reordering, access.lexical_reordering(row).begin());
       }
-      ParseFloats(dense_features, access.dense_features, row, TakeLogAndMosesFloor());
-      ParseFloats(lexical_reordering, access.lexical_reordering, row, TakeLogAndMosesFloor());
-      // TODO sparse features
  
-      if (!++line) break;
-      ExtractLine(*line, parsed_line);
-    } while ((new_source_hash = source_hasher(source)) == source_hash);
+      if (!++parsed) break;
+    } while ((new_source_hash = source_hasher(parsed.SourceBegin(), parsed.SourceEnd(), parsed.Base())) == source_hash);
+    rank(bundle);
     source_hash = new_source_hash;
   }
-  stats.max_source_phrase_length = source_hasher.MaxSourcePhraseLength();
-  stats.vocab_size = vocab.Size();
-
+  chain.Wait();
   vocab.Action().Finish();
-  file.Write();
+  for (std::unique_ptr<Shard> &shard : shards) {
+    shard->Stats().max_source_phrase_length = source_hasher.MaxSourcePhraseLength();
+    shard->Stats().vocab_size = vocab.Size();
+    shard->Write();
+  }
 }
 
 } // namespace pt
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstddef>
+#include <string>
+#include <vector>
 
 namespace pt {
 
@@ -14,7 +16,33 @@ struct TextColumns {
   std::size_t lexical_reordering = 4;
 };
 
+// Resources used while building.
+struct CreateConfig {
+  // Bytes for sorting the source phrase index.  0 keeps the index in memory
+  // instead.  Target phrases are always streamed to disk and the vocabulary
+  // is always in memory.
+  std::size_t index_memory = 0;
+  // Where sorting puts temporary files.
+  std::string temp_prefix;
+  // Threads parsing text.  Reading and writing have a thread each.
+  std::size_t threads = 1;
+  // Sort the target phrases of each source phrase by the dot product of
+  // these weights with their dense features, best first.  Empty leaves them
+  // in the order of the text.
+  std::vector<float> rank_weights;
+  // Keep at most this many target phrases for each source phrase after
+  // ranking, 0 for all.  Requires rank_weights.
+  std::size_t table_limit = 0;
+  // Write rows with CompactTable.  The raw table is built in temp_prefix
+  // first.
+  bool compact = false;
+};
+
 // Takes ownership of from and to files.
-void CreateTable(int from, int to, const TextColumns columns, FieldConfig &config);
+void CreateTable(int from, int to, const TextColumns columns, FieldConfig &config, const CreateConfig &create = CreateConfig());
+
+// Split the table by source phrase into to.size() files, which Table opens
+// together when they are named by ShardFile.  Takes ownership of all files.
+void CreateTable(int from, const std::vector<int> &to, const TextColumns columns, FieldConfig &config, const CreateConfig &create = CreateConfig());
 
 } // namespace pt
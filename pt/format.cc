@@ -1,5 +1,7 @@
 #include "pt/format.hh"
 
+#include <vector>
+
 namespace pt {
 
 namespace {
@@ -11,7 +13,11 @@ struct SizeHeader {
 };
 } // namespace
 
-const char kFileHeader[] = "mtplz phrase table version 0\n";
+const char kFileHeader[] = "mtplz phrase table version 1\n";
+
+std::string ShardFile(const std::string &base, std::size_t shard) {
+  return shard ? (base + '.' + std::to_string(shard)) : base;
+}
 
 FileFormat::FileFormat(int fd, const std::string &header, bool writing, util::LoadMethod load_method)
   : file_(fd), writing_(writing), header_offset_(header.size() + sizeof(SizeHeader)) {
@@ -43,6 +49,7 @@ FileFormat::FileFormat(int fd, const std::string &header, bool writing, util::Lo
 util::scoped_memory &FileFormat::Attach() {
   if (writing_) {
     regions_.emplace_back();
+    streamed_.push_back(NULL);
   } else {
     char *base = regions_.empty() ? (full_backing_.begin() + header_offset_) : regions_.back().end();
     const uint64_t &size = *reinterpret_cast<const uint64_t*>(base);
@@ -52,16 +59,26 @@ util::scoped_memory &FileFormat::Attach() {
   return regions_.back();
 }
 
+void FileFormat::AttachStreamed(StreamedRegion &region) {
+  assert(writing_);
+  regions_.emplace_back();
+  streamed_.push_back(&region);
+}
+
 void FileFormat::Write() {
+  std::vector<uint64_t> sizes;
+  for (std::size_t i = 0; i < regions_.size(); ++i) {
+    sizes.push_back(streamed_[i] ? streamed_[i]->Size() : regions_[i].size());
+  }
   SizeHeader head;
   head.total = sizeof(uint64_t) + direct_write_size_;
-  for (util::scoped_memory &r : regions_) {
+  for (uint64_t size : sizes) {
     // Include size headers.
-    head.total += sizeof(uint64_t) + r.size();
+    head.total += sizeof(uint64_t) + size;
   }
   // Exclude the vocabulary from the mapped region.
   assert(!regions_.empty());
-  head.map = head.total - (regions_.back().size() + sizeof(uint64_t));
+  head.map = head.total - (sizes.back() + sizeof(uint64_t));
   // Write the total file size header.
   util::SeekOrThrow(file_.get(), header_offset_ - sizeof(SizeHeader));
   util::WriteOrThrow(file_.get(), &head, sizeof(SizeHeader));
@@ -70,10 +87,16 @@ void FileFormat::Write() {
   // Skip over the direct-write region.
   util::SeekOrThrow(file_.get(), header_offset_ + sizeof(uint64_t) + direct_write_size_);
   // Write the regions with their own size headers.  This includes vocab.
-  for (util::scoped_memory &r : regions_) {
-    uint64_t size = r.size();
-    util::WriteOrThrow(file_.get(), &size, sizeof(uint64_t));
-    util::WriteOrThrow(file_.get(), r.get(), r.size());
+  uint64_t offset = header_offset_ + sizeof(uint64_t) + direct_write_size_;
+  for (std::size_t i = 0; i < regions_.size(); ++i) {
+    util::WriteOrThrow(file_.get(), &sizes[i], sizeof(uint64_t));
+    offset += sizeof(uint64_t);
+    if (streamed_[i]) {
+      streamed_[i]->WriteTo(file_.get(), offset);
+    } else {
+      util::WriteOrThrow(file_.get(), regions_[i].get(), sizes[i]);
+    }
+    offset += sizes[i];
   }
 }
 
@@ -18,6 +18,7 @@
 #include <cassert>
 #include <cstddef>
 #include <deque>
+#include <string>
 
 namespace pt {
 
@@ -36,6 +37,22 @@ class VocabRange {
     util::FilePiece file_;
 };
 
+// Name of file shard of a table split into several, where shard 0 is base.
+std::string ShardFile(const std::string &base, std::size_t shard);
+
+// A region that is too big to keep in memory while building.  It is
+// produced when the file is written.
+class StreamedRegion {
+  public:
+    virtual ~StreamedRegion() {}
+
+    // Size in bytes, final by the time FileFormat::Write is called.
+    virtual uint64_t Size() const = 0;
+
+    // Write exactly Size() bytes to fd, which is positioned at offset.
+    virtual void WriteTo(int fd, uint64_t offset) = 0;
+};
+
 class FileFormat {
   public:
     // Takes ownership of file.
@@ -43,6 +60,9 @@ class FileFormat {
 
     util::scoped_memory &Attach();
 
+    // Writing only.  The region is read back with Attach like any other.
+    void AttachStreamed(StreamedRegion &region);
+
     // Two special regions:
     // 1. Target phrases at the beginning are written directly to the file.
     void DirectWriteTargetPhrases(void *data, std::size_t size) {
@@ -65,6 +85,8 @@ class FileFormat {
     bool writing_;
 
     std::deque<util::scoped_memory> regions_;
+    // Parallel to regions_: NULL unless the region was attached with AttachStreamed.
+    std::deque<StreamedRegion*> streamed_;
 
     // When the file is mapped as one giant region, this is the giant region.
     util::scoped_memory full_backing_;
@@ -1,12 +1,55 @@
 #pragma once
 
 #include "pt/types.hh"
-#include "util/murmur_hash.hh"
+
+#include <cstddef>
 
 namespace pt {
 
+const uint64_t kSourceHashSeed = 1323231561ULL /* mashed on keyboard */;
+
+// Source phrases are hashed a word at a time, so the hash of a phrase extends
+// the hash of its prefix and every span starting at the same word can be
+// hashed in one pass.  This is the splitmix64 finalizer, which is a
+// bijection, so phrases only collide if prefix ^ word does.
+inline uint64_t HashExtend(uint64_t prefix, WordIndex word) {
+  uint64_t ret = prefix ^ word;
+  ret = (ret ^ (ret >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  ret = (ret ^ (ret >> 27)) * 0x94d049bb133111ebULL;
+  return ret ^ (ret >> 31);
+}
+
 inline uint64_t HashSource(const WordIndex *begin, const WordIndex *end) {
-  return util::MurmurHash64A(begin, sizeof(WordIndex) * (end - begin), 1323231561ULL /* mashed on keyboard */);
+  uint64_t ret = kSourceHashSeed;
+  for (; begin != end; ++begin) {
+    ret = HashExtend(ret, *begin);
+  }
+  return ret;
 }
 
+// Which shard holds a source phrase hash.  This uses the high bits because
+// the low bits pick the bucket within each shard's hash table.
+inline std::size_t ShardOf(uint64_t source_hash, std::size_t shards) {
+  return shards == 1 ? 0 : (source_hash >> 32) % shards;
+}
+
+/* Values in the source phrase index are the offset of the target phrases in
+ * the rows region plus flags.  Every proper prefix of a source phrase is in
+ * the index with kIndexLonger set, so a lookup that misses means no longer
+ * phrase starts with the span either.  Prefixes that are not phrases
+ * themselves also have kIndexNoRows.
+ */
+const uint64_t kIndexLonger = 1ULL << 63;
+const uint64_t kIndexNoRows = 1ULL << 62;
+const uint64_t kIndexOffset = kIndexNoRows - 1;
+
+// Merge two index values for the same source phrase.  Targets come from the
+// first that has them.
+struct CombineIndex {
+  uint64_t operator()(uint64_t first, uint64_t second) const {
+    uint64_t rows = (first & kIndexNoRows) ? second : first;
+    return (rows & ~kIndexLonger) | ((first | second) & kIndexLonger);
+  }
+};
+
 } // namespace pt
@@ -11,9 +11,22 @@
 namespace pt {
 
 template <class Value> class HashTableRegion {
-  private:
-    static constexpr float kDefaultMultiply = 1.2;
   public:
+    static constexpr float kDefaultMultiply = 1.2;
+
+    // On-disk layout, also written by SpillingHashTableRegion.
+    struct Entry {
+      Entry(uint64_t k, const Value &v) : key(k), value(v) {}
+      Entry() {}
+      typedef uint64_t Key;
+      uint64_t key;
+      uint64_t GetKey() const { return key; }
+      void SetKey(uint64_t to) { key = to; }
+      Value value;
+    };
+
+    typedef util::ProbingHashTable<Entry, util::IdentityHash, std::equal_to<uint64_t>, util::Power2Mod> Table;
+
     explicit HashTableRegion(FileFormat &format) : backing_(format.Attach()) {
       if (format.Writing()) {
         HugeRealloc(Table::Size(10, kDefaultMultiply), true, backing_);
@@ -23,17 +36,23 @@ template <class Value> class HashTableRegion {
     }
 
     void Insert(uint64_t hash, const Value &value) {
-      if (table_.SizeNoSerialization() > insert_threshold_) {
-        HugeRealloc(table_.DoubleTo(), true, backing_);
-        table_.Double(backing_.get(), false);
-        insert_threshold_ = table_.Buckets() / kDefaultMultiply;
-      }
+      Grow();
       Entry entry;
       entry.key = hash;
       entry.value = value;
       table_.Insert(entry);
     }
 
+    // Insert or, if hash is already present, replace its value with
+    // combine(existing, value).
+    template <class Combine> void InsertOrCombine(uint64_t hash, const Value &value, const Combine &combine) {
+      Grow();
+      typename Table::MutableIterator i;
+      if (table_.FindOrInsert(Entry(hash, value), i)) {
+        i->value = combine(i->value, value);
+      }
+    }
+
     bool Find(uint64_t hash, const Value *&found) const {
       typename Table::ConstIterator i;
       if (table_.Find(hash, i)) {
@@ -43,18 +62,27 @@ template <class Value> class HashTableRegion {
       return false;
     }
 
+    // Find split in two so callers can prefetch the bucket in between.
+    const Entry *Ideal(uint64_t hash) const { return table_.Ideal(hash); }
+
+    bool FindFromIdeal(uint64_t hash, const Entry *ideal, const Value *&found) const {
+      typename Table::ConstIterator i = ideal;
+      if (table_.FindFromIdeal(hash, i)) {
+        found = &i->value;
+        return true;
+      }
+      return false;
+    }
+
   private:
-    struct Entry {
-      Entry(uint64_t k, const Value &v) : key(k), value(v) {}
-      Entry() {}
-      typedef uint64_t Key;
-      uint64_t key;
-      uint64_t GetKey() const { return key; }
-      void SetKey(uint64_t to) { key = to; }
-      Value value;
-    };
+    void Grow() {
+      if (table_.SizeNoSerialization() > insert_threshold_) {
+        HugeRealloc(table_.DoubleTo(), true, backing_);
+        table_.Double(backing_.get(), false);
+        insert_threshold_ = table_.Buckets() / kDefaultMultiply;
+      }
+    }
 
-    typedef util::ProbingHashTable<Entry, util::IdentityHash, std::equal_to<uint64_t>, util::Power2Mod> Table;
     Table table_;
 
     std::size_t insert_threshold_;
@@ -0,0 +1,96 @@
+#include "pt/lm_state.hh"
+
+#include "pt/access.hh"
+#include "pt/format.hh"
+#include "pt/rewrite.hh"
+#include "util/exception.hh"
+#include "util/pool.hh"
+
+#include <algorithm>
+#include <limits>
+
+namespace pt {
+
+namespace {
+
+template <class Field> void CopyVector(const Field &from_field, const Row *from, const Field &to_field, Row *&to, util::Pool &pool) {
+  auto in = from_field(from);
+  auto out = to_field(to, pool);
+  out.resize(in.size());
+  std::copy(in.begin(), in.end(), out.begin());
+}
+
+template <class Field> void CopyArray(const Field &from_field, const Row *from, const Field &to_field, Row *to) {
+  auto in = from_field(from);
+  std::copy(in.begin(), in.end(), to_field(to).begin());
+}
+
+class StateAdder : public BundleWriter {
+  public:
+    StateAdder(const Access &in, Access &out, const LMStateFunction &state, FileFormat &format)
+      : BundleWriter(format), in_(in), out_(out), state_function_(state) {}
+
+    void AddRow(const Row *row) {
+      state_.clear();
+      state_function_(in_, row, state_);
+      std::size_t variable = state_.size();
+      if (in_.target) variable += in_.target(row).size() * sizeof(WordIndex);
+      if (in_.sparse_features) variable += in_.sparse_features(row).size() * sizeof(SparseFeature);
+      UTIL_THROW_IF2(variable > std::numeric_limits<VectorSize>::max(), "A row with " << state_.size() << " bytes of language model state is too long for the table format.");
+
+      pool_.Reset();
+      Row *to = out_.Allocate(pool_);
+      // Vectors are sized in the order Access attached them.
+      if (in_.target) CopyVector(in_.target, row, out_.target, to, pool_);
+      if (in_.dense_features) CopyArray(in_.dense_features, row, out_.dense_features, to);
+      if (in_.sparse_features) CopyVector(in_.sparse_features, row, out_.sparse_features, to, pool_);
+      if (in_.lexical_reordering) CopyArray(in_.lexical_reordering, row, out_.lexical_reordering, to);
+      auto state = out_.lm_state(to, pool_);
+      state.resize(state_.size());
+      std::copy(state_.begin(), state_.end(), state.begin());
+
+      const uint8_t *begin = reinterpret_cast<const uint8_t*>(to);
+      buffer_.insert(buffer_.end(), begin, reinterpret_cast<const uint8_t*>(out_.End(to)));
+    }
+
+  private:
+    const Access &in_;
+    Access &out_;
+    const LMStateFunction &state_function_;
+
+    std::vector<uint8_t> state_;
+    util::Pool pool_;
+};
+
+} // namespace
+
+void AddLMStates(int from, int to, uint64_t checksum, const LMStateFunction &state) {
+  FileFormat in(from, kFileHeader, false, util::LAZY);
+  const util::scoped_memory &rows = in.Attach();
+  const util::scoped_memory &stats = in.Attach();
+  FieldConfig config;
+  config.Restore(in.Attach());
+  UTIL_THROW_IF2(config.compact, "Compact phrase tables do not support language model state.");
+  UTIL_THROW_IF2(!config.target, "Language model state needs target phrases.");
+  const util::scoped_memory &offsets = in.Attach();
+  Access in_access(config);
+
+  FileFormat out(to, kFileHeader, true, util::POPULATE_OR_READ /* does not matter since this is the reading method */);
+  CopyRegion(stats, out.Attach());
+  config.lm_state = true;
+  config.lm_checksum = checksum;
+  config.Save(out.Attach());
+  Access out_access(config);
+
+  StateAdder adder(in_access, out_access, state, out);
+  ForEachBundle(rows, in_access, adder);
+  adder.Flush();
+
+  RemappedOffsets remapped(offsets, adder);
+  out.AttachStreamed(remapped);
+
+  CopyVocab(in, out);
+  out.Write();
+}
+
+} // namespace pt
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pt/types.hh"
+
+#include <boost/function.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace pt {
+
+class Access;
+
+// Set state to the language model state of row, which is read with access.
+typedef boost::function<void (const Access &access, const Row *row, std::vector<uint8_t> &state)> LMStateFunction;
+
+/* Rewrite the table in from to to with FieldConfig::lm_state, filled by
+ * state for each row, and lm_checksum set to checksum.  State already in
+ * the table is replaced.  Compact tables are not supported.  Takes ownership
+ * of from and to.
+ */
+void AddLMStates(int from, int to, uint64_t checksum, const LMStateFunction &state);
+
+} // namespace pt
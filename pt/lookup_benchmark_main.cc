@@ -0,0 +1,132 @@
+// Time phrase table lookups of every span of synthetic sentences drawn from
+// the table's vocabulary, one at a time and in batches.  Reports lookups per
+// second for each.
+#include "pt/format.hh"
+#include "pt/query.hh"
+#include "pt/statistics.hh"
+#include "util/file.hh"
+#include "util/usage.hh"
+
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+
+namespace pt {
+namespace {
+
+// Ask the kernel to drop the table's files from the page cache.  This only
+// works for pages that are clean and not mapped, so call it with the table
+// closed.
+void DropCache(const std::string &file, uint64_t shards) {
+  for (uint64_t i = 0; i < shards; ++i) {
+    util::scoped_fd fd(util::OpenReadOrThrow(ShardFile(file, i).c_str()));
+    posix_fadvise(fd.get(), 0, 0, POSIX_FADV_DONTNEED);
+  }
+}
+
+// Returns the number of target phrases found, so lookups are not optimized
+// away.
+uint64_t Serial(const Table &table, const std::vector<SourceSpan> &spans) {
+  uint64_t found = 0;
+  for (const SourceSpan &span : spans) {
+    boost::iterator_range<RowIterator> rows(table.Lookup(span));
+    found += rows.end() - rows.begin();
+  }
+  return found;
+}
+
+uint64_t Batched(const Table &table, const std::vector<SourceSpan> &spans, std::size_t batch) {
+  uint64_t found = 0;
+  std::vector<SourceLookup> out(batch);
+  for (std::size_t i = 0; i < spans.size(); i += batch) {
+    std::size_t count = std::min(batch, spans.size() - i);
+    table.Lookup(&spans[i], count, out.data());
+    for (std::size_t j = 0; j < count; ++j) {
+      found += out[j].rows.end() - out[j].rows.begin();
+    }
+  }
+  return found;
+}
+
+} // namespace
+} // namespace pt
+
+int main(int argc, char *argv[]) {
+  try {
+    namespace po = boost::program_options;
+    po::options_description options("Phrase table lookup benchmark options");
+    std::string phrase_file;
+    std::size_t length, sentences;
+    unsigned int seed;
+    bool cold;
+
+    options.add_options()
+      ("phrase,p", po::value<std::string>(&phrase_file)->required(), "Phrase table")
+      ("length", po::value<std::size_t>(&length)->default_value(100), "Words per sentence.  Lookups are batched by sentence.")
+      ("sentences", po::value<std::size_t>(&sentences)->default_value(1000), "Sentences to look up")
+      ("seed", po::value<unsigned int>(&seed)->default_value(1), "Random seed for sentences")
+      ("cold", po::bool_switch(&cold), "Drop the table from the page cache before each run instead of loading it into memory first");
+    if (argc == 1) {
+      std::cerr << options << std::endl;
+      return 1;
+    }
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+
+    using namespace pt;
+    uint64_t shards, vocab_size, max_length;
+    {
+      Table table(phrase_file.c_str(), util::LAZY);
+      shards = table.Stats().shards;
+      vocab_size = table.Stats().vocab_size;
+      max_length = table.Stats().max_source_phrase_length;
+    }
+
+    // Skip <unk>, <s>, and </s>.
+    boost::random::mt19937 gen(seed);
+    boost::random::uniform_int_distribution<WordIndex> word(3, vocab_size - 1);
+    std::vector<WordIndex> words(length * sentences);
+    for (WordIndex &w : words) {
+      w = word(gen);
+    }
+    std::vector<SourceSpan> spans;
+    for (std::size_t sentence = 0; sentence < sentences; ++sentence) {
+      const WordIndex *base = &words[sentence * length];
+      for (std::size_t begin = 0; begin < length; ++begin) {
+        for (std::size_t end = begin + 1; end <= length && end <= begin + max_length; ++end) {
+          SourceSpan span = {base + begin, base + end};
+          spans.push_back(span);
+        }
+      }
+    }
+    const std::size_t batch = spans.size() / sentences;
+
+    for (bool batched = false; ; batched = true) {
+      if (cold) DropCache(phrase_file, shards);
+      Table table(phrase_file.c_str(), cold ? util::LAZY : util::POPULATE_OR_READ);
+      if (!cold) {
+        // Warm the CPU caches and TLB as far as they go.
+        Serial(table, spans);
+      }
+      double start = util::WallTime();
+      uint64_t found = batched ? Batched(table, spans, batch) : Serial(table, spans);
+      double took = util::WallTime() - start;
+      std::cout << (batched ? "Batched " : "Serial ") << (spans.size() / took) << " lookups/s, "
+        << found << " target phrases in " << took << " s\n";
+      if (batched) break;
+    }
+    util::PrintUsage(std::cerr);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -3,10 +3,23 @@
 
 #include "pt/access.hh"
 #include "pt/create.hh"
+#include "pt/format.hh"
+#include "pt/hash_table_region.hh"
+#include "pt/lm_state.hh"
 #include "pt/query.hh"
+#include "pt/spilling_hash_table_region.hh"
+#include "pt/statistics.hh"
 #include "util/file.hh"
+#include "util/pool.hh"
 
 #include <cmath>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 namespace pt { namespace {
 
@@ -63,4 +76,361 @@ BOOST_AUTO_TEST_CASE(CreateAndQuery) {
   BOOST_CHECK_CLOSE(std::log(0.25), row.Accessor().dense_features(row)[0], 0.001);
 }
 
+// Source s<i> has target t<i>, so their ids are 3 + 2 * i and 4 + 2 * i.
+util::scoped_fd MakeNumberedFile(std::size_t sources) {
+  util::scoped_fd file(util::MakeTemp(util::DefaultTempDirectory()));
+  std::string text;
+  for (std::size_t i = 0; i < sources; ++i) {
+    text += "s" + std::to_string(i) + " ||| t" + std::to_string(i) + " ||| 0.5\n";
+  }
+  util::WriteOrThrow(file.get(), text.data(), text.size());
+  util::SeekOrThrow(file.get(), 0);
+  return file;
+}
+
+void CheckNumbered(const Table &table, std::size_t sources) {
+  for (WordIndex i = 0; i < sources; ++i) {
+    WordIndex source = 3 + 2 * i;
+    boost::iterator_range<RowIterator> targets(table.Lookup(&source, &source + 1));
+    RowIterator row = targets.begin();
+    BOOST_REQUIRE(row != targets.end());
+    BOOST_REQUIRE_EQUAL(1, row.Accessor().target(row).size());
+    BOOST_CHECK_EQUAL(4 + 2 * i, row.Accessor().target(row)[0]);
+    BOOST_CHECK(++row == targets.end());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SpillIndex) {
+  const std::size_t kSources = 1000;
+  util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+  TextColumns columns;
+  FieldConfig fields;
+  fields.dense_features = 1;
+  CreateConfig create;
+  create.index_memory = 4096;
+  create.temp_prefix = util::DefaultTempDirectory();
+  CreateTable(MakeNumberedFile(kSources).release(), util::DupOrThrow(binary.get()), columns, fields, create);
+  util::SeekOrThrow(binary.get(), 0);
+  Table table(binary.release(), util::READ);
+  CheckNumbered(table, kSources);
+}
+
+struct KeepFirst {
+  uint64_t operator()(uint64_t first, uint64_t) const { return first; }
+};
+
+// Entries whose ideal bucket is the last run off the end and wrap around to
+// the front.  The output is write-only, like stdout redirected to a file.
+BOOST_AUTO_TEST_CASE(SpillWrapWriteOnly) {
+  const uint64_t kWrapping = 10;
+  std::string name = util::DefaultTempDirectory() + "pt_test_XXXXXX";
+  util::scoped_fd reader(mkstemp(&name[0]));
+  BOOST_REQUIRE(reader.get() != -1);
+  util::scoped_fd writer(open(name.c_str(), O_WRONLY));
+  BOOST_REQUIRE(writer.get() != -1);
+  unlink(name.c_str());
+  {
+    FileFormat out(writer.release(), kFileHeader, true, util::POPULATE_OR_READ);
+    SpillingHashTableRegion<uint64_t, KeepFirst> region(out, 1 << 20, util::DefaultTempDirectory());
+    // Low bits all set make the last bucket ideal.
+    for (uint64_t i = 1; i <= kWrapping; ++i) {
+      region.Insert((i << 32) | 0xffffffff, i);
+    }
+    // Ideal bucket 0, which wrapped entries have to skip.
+    region.Insert(1ULL << 40, 100);
+    region.Finish();
+    // Stands in for the vocabulary, which is not mapped.
+    out.Attach();
+    out.Write();
+  }
+
+  FileFormat in(reader.release(), kFileHeader, false, util::READ);
+  in.Attach();
+  HashTableRegion<uint64_t> table(in);
+  const uint64_t *found;
+  for (uint64_t i = 1; i <= kWrapping; ++i) {
+    BOOST_REQUIRE(table.Find((i << 32) | 0xffffffff, found));
+    BOOST_CHECK_EQUAL(i, *found);
+  }
+  BOOST_REQUIRE(table.Find(1ULL << 40, found));
+  BOOST_CHECK_EQUAL(100, *found);
+  BOOST_CHECK(!table.Find(12345, found));
+}
+
+BOOST_AUTO_TEST_CASE(BatchLookup) {
+  // More phrases than the lookup pipeline is deep, half of them missing.
+  const std::size_t kSources = 100;
+  util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+  TextColumns columns;
+  FieldConfig fields;
+  fields.dense_features = 1;
+  CreateTable(MakeNumberedFile(kSources).release(), util::DupOrThrow(binary.get()), columns, fields);
+  util::SeekOrThrow(binary.get(), 0);
+  Table table(binary.release(), util::READ);
+
+  std::vector<WordIndex> words;
+  for (WordIndex i = 0; i < 2 * kSources; ++i) {
+    words.push_back(3 + i);
+  }
+  std::vector<SourceSpan> spans;
+  for (std::size_t i = 0; i < words.size(); ++i) {
+    SourceSpan span = {&words[i], &words[i] + 1};
+    spans.push_back(span);
+  }
+  std::vector<SourceLookup> batch(spans.size());
+  table.Lookup(spans.data(), spans.size(), batch.data());
+  for (std::size_t i = 0; i < spans.size(); ++i) {
+    boost::iterator_range<RowIterator> single(table.Lookup(spans[i].begin, spans[i].end));
+    BOOST_REQUIRE_EQUAL(single.end() - single.begin(), batch[i].rows.end() - batch[i].rows.begin());
+    BOOST_CHECK_EQUAL(i % 2 == 0, !batch[i].rows.empty());
+    BOOST_CHECK(!batch[i].longer);
+    if (!single.empty()) {
+      BOOST_CHECK(static_cast<const Row*>(single.begin()) == static_cast<const Row*>(batch[i].rows.begin()));
+    }
+  }
+}
+
+std::string ReadAll(int fd) {
+  std::string ret(util::SizeOrThrow(fd), 0);
+  util::SeekOrThrow(fd, 0);
+  util::ReadOrThrow(fd, &ret[0], ret.size());
+  return ret;
+}
+
+BOOST_AUTO_TEST_CASE(ParallelParse) {
+  // Enough text for several parsing blocks.
+  const std::size_t kSources = 40000;
+  std::string binaries[2];
+  for (std::size_t threads = 1; threads <= 3; threads += 2) {
+    util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+    TextColumns columns;
+    FieldConfig fields;
+    fields.dense_features = 1;
+    CreateConfig create;
+    create.threads = threads;
+    CreateTable(MakeNumberedFile(kSources).release(), util::DupOrThrow(binary.get()), columns, fields, create);
+    binaries[threads / 2] = ReadAll(binary.get());
+    if (threads == 3) {
+      util::SeekOrThrow(binary.get(), 0);
+      Table table(binary.release(), util::READ);
+      CheckNumbered(table, kSources);
+    }
+  }
+  // Parsing threads do not change the result.
+  BOOST_CHECK(binaries[0] == binaries[1]);
+}
+
+BOOST_AUTO_TEST_CASE(Shards) {
+  const std::size_t kSources = 100, kShards = 3;
+  // Sharded tables are opened by name.
+  util::scoped_fd reserve(util::MakeTemp(util::DefaultTempDirectory()));
+  const std::string base(util::DefaultTempDirectory() + "phrase_table_test_" + std::to_string(reserve.get()));
+  std::vector<int> to;
+  for (std::size_t i = 0; i < kShards; ++i) {
+    to.push_back(util::CreateOrThrow(ShardFile(base, i).c_str()));
+  }
+  TextColumns columns;
+  FieldConfig fields;
+  fields.dense_features = 1;
+  CreateConfig create;
+  create.index_memory = 4096;
+  create.temp_prefix = util::DefaultTempDirectory();
+  CreateTable(MakeNumberedFile(kSources).release(), to, columns, fields, create);
+  {
+    Table table(base.c_str(), util::READ);
+    BOOST_CHECK_EQUAL(kShards, table.Stats().shards);
+    CheckNumbered(table, kSources);
+  }
+  for (std::size_t i = 0; i < kShards; ++i) {
+    remove(ShardFile(base, i).c_str());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RankAndLimit) {
+  TextColumns columns;
+  FieldConfig fields;
+  fields.dense_features = 1;
+  CreateConfig create;
+  // Prefer the lower first feature, which puts B A ahead of B A C.
+  create.rank_weights = {-1.0, 0.0, 0.0, 0.0, 0.0};
+  for (std::size_t limit = 0; limit < 2; ++limit) {
+    create.table_limit = limit;
+    util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+    CreateTable(MakeFile().release(), util::DupOrThrow(binary.get()), columns, fields, create);
+    util::SeekOrThrow(binary.get(), 0);
+    Table table(binary.release(), util::READ);
+    WordIndex abc[3] = {3, 4, 5};
+    boost::iterator_range<RowIterator> targets(table.Lookup(abc, abc + 3));
+    RowIterator row = targets.begin();
+    BOOST_REQUIRE(row != targets.end());
+    BOOST_CHECK_EQUAL(2, row.Accessor().target(row).size());
+    BOOST_CHECK_CLOSE(std::log(0.1), row.Accessor().dense_features(row)[0], 0.001);
+    ++row;
+    if (limit) {
+      BOOST_CHECK(row == targets.end());
+    } else {
+      BOOST_REQUIRE(row != targets.end());
+      BOOST_CHECK_EQUAL(3, row.Accessor().target(row).size());
+      BOOST_CHECK(++row == targets.end());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(Prefixes) {
+  // d e has no targets of its own but is a prefix of d e f.
+  const char text[] =
+    "a ||| A ||| 0.5\n"
+    "a b ||| A B ||| 0.5\n"
+    "d e f ||| D E F ||| 0.5\n";
+  for (std::size_t index_memory = 0; index_memory <= 4096; index_memory += 4096) {
+    util::scoped_fd file(util::MakeTemp(util::DefaultTempDirectory()));
+    util::WriteOrThrow(file.get(), text, sizeof(text) - 1);
+    util::SeekOrThrow(file.get(), 0);
+    util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+    TextColumns columns;
+    FieldConfig fields;
+    fields.dense_features = 1;
+    CreateConfig create;
+    create.index_memory = index_memory;
+    create.temp_prefix = util::DefaultTempDirectory();
+    CreateTable(file.release(), util::DupOrThrow(binary.get()), columns, fields, create);
+    util::SeekOrThrow(binary.get(), 0);
+    Table table(binary.release(), util::READ);
+
+    // Vocabulary: a=3 A=4 b=5 B=6 d=7 e=8 f=9.
+    WordIndex words[] = {3, 5, 7, 8, 9, 4};
+    SourceSpan spans[] = {
+      {words, words + 1}, // a
+      {words, words + 2}, // a b
+      {words + 2, words + 3}, // d
+      {words + 2, words + 4}, // d e
+      {words + 2, words + 5}, // d e f
+      {words + 5, words + 6}, // A
+    };
+    SourceLookup out[6];
+    table.Lookup(spans, 6, out);
+    BOOST_CHECK(!out[0].rows.empty());
+    BOOST_CHECK(out[0].longer);
+    BOOST_CHECK(!out[1].rows.empty());
+    BOOST_CHECK(!out[1].longer);
+    BOOST_CHECK(out[2].rows.empty());
+    BOOST_CHECK(out[2].longer);
+    BOOST_CHECK(out[3].rows.empty());
+    BOOST_CHECK(out[3].longer);
+    BOOST_CHECK(!out[4].rows.empty());
+    BOOST_CHECK(!out[4].longer);
+    BOOST_CHECK(out[5].rows.empty());
+    BOOST_CHECK(!out[5].longer);
+    BOOST_CHECK(table.Lookup(spans[3].begin, spans[3].end).empty());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(Compact) {
+  util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+  TextColumns columns;
+  FieldConfig fields;
+  fields.dense_features = 1;
+  CreateConfig create;
+  create.compact = true;
+  create.temp_prefix = util::DefaultTempDirectory();
+  CreateTable(MakeFile().release(), util::DupOrThrow(binary.get()), columns, fields, create);
+  util::SeekOrThrow(binary.get(), 0);
+  Table table(binary.release(), util::READ);
+
+  VocabRange range(table.Vocab());
+  VocabRange::Iterator it(range.begin());
+  BOOST_REQUIRE(it);
+  BOOST_CHECK_EQUAL("<unk>", *it);
+
+  util::Pool pool;
+  WordIndex abc[3] = {3, 4, 5};
+  boost::iterator_range<RowIterator> abc_targets(table.Lookup(abc, abc + 3));
+  RowIterator row = abc_targets.begin();
+  BOOST_REQUIRE(row != abc_targets.end());
+  const Row *decoded = row.Decode(pool);
+  BOOST_REQUIRE_EQUAL(3, row.Accessor().target(decoded).size());
+  BOOST_CHECK_EQUAL(6, row.Accessor().target(decoded)[0]);
+  BOOST_CHECK_EQUAL(7, row.Accessor().target(decoded)[1]);
+  BOOST_CHECK_EQUAL(8, row.Accessor().target(decoded)[2]);
+  BOOST_REQUIRE_EQUAL(5, row.Accessor().dense_features(decoded).size());
+  // Few enough values that every one has its own bin.
+  BOOST_CHECK_CLOSE(std::log(0.25), row.Accessor().dense_features(decoded)[0], 0.001);
+  BOOST_CHECK_CLOSE(std::log(2.718), row.Accessor().dense_features(decoded)[4], 0.001);
+
+  BOOST_REQUIRE(++row != abc_targets.end());
+  decoded = row.Decode(pool);
+  BOOST_REQUIRE_EQUAL(2, row.Accessor().target(decoded).size());
+  BOOST_CHECK_CLOSE(std::log(0.1), row.Accessor().dense_features(decoded)[0], 0.001);
+  BOOST_CHECK(++row == abc_targets.end());
+
+  WordIndex de[2] = {9, 10};
+  boost::iterator_range<RowIterator> de_targets(table.Lookup(de, de + 2));
+  BOOST_REQUIRE(de_targets.begin() != de_targets.end());
+  BOOST_CHECK_EQUAL(3, row.Accessor().target(de_targets.begin().Decode(pool)).size());
+}
+
+// Stand in for language model state: the target words as bytes then tag.
+void FakeState(uint8_t tag, const Access &access, const Row *row, std::vector<uint8_t> &state) {
+  for (WordIndex word : access.target(row)) {
+    state.push_back(word);
+  }
+  state.push_back(tag);
+}
+
+void CheckFakeState(const Table &table, uint8_t tag) {
+  WordIndex abc[3] = {3, 4, 5};
+  boost::iterator_range<RowIterator> abc_targets(table.Lookup(abc, abc + 3));
+  RowIterator row = abc_targets.begin();
+  BOOST_REQUIRE(row != abc_targets.end());
+  const Access &access = row.Accessor();
+  BOOST_REQUIRE(access.lm_state);
+  BOOST_REQUIRE_EQUAL(3, access.target(row).size());
+  BOOST_CHECK_EQUAL(6, access.target(row)[0]);
+  BOOST_CHECK_EQUAL(8, access.target(row)[2]);
+  BOOST_REQUIRE_EQUAL(5, access.dense_features(row).size());
+  BOOST_CHECK_CLOSE(std::log(2.718), access.dense_features(row)[4], 0.001);
+  BOOST_REQUIRE_EQUAL(4, access.lm_state(row).size());
+  BOOST_CHECK_EQUAL(6, access.lm_state(row)[0]);
+  BOOST_CHECK_EQUAL(8, access.lm_state(row)[2]);
+  BOOST_CHECK_EQUAL(tag, access.lm_state(row)[3]);
+
+  BOOST_REQUIRE(++row != abc_targets.end());
+  BOOST_CHECK_EQUAL(2, access.target(row).size());
+  BOOST_CHECK_EQUAL(3, access.lm_state(row).size());
+  BOOST_CHECK(++row == abc_targets.end());
+
+  WordIndex de[2] = {9, 10};
+  boost::iterator_range<RowIterator> de_targets(table.Lookup(de, de + 2));
+  BOOST_REQUIRE(de_targets.begin() != de_targets.end());
+  BOOST_CHECK_EQUAL(4, access.lm_state(de_targets.begin()).size());
+}
+
+BOOST_AUTO_TEST_CASE(LMStates) {
+  util::scoped_fd raw(util::MakeTemp(util::DefaultTempDirectory()));
+  TextColumns columns;
+  FieldConfig fields;
+  fields.dense_features = 1;
+  CreateTable(MakeFile().release(), util::DupOrThrow(raw.get()), columns, fields);
+  util::SeekOrThrow(raw.get(), 0);
+
+  util::scoped_fd binary(util::MakeTemp(util::DefaultTempDirectory()));
+  AddLMStates(raw.release(), util::DupOrThrow(binary.get()), 1234, [](const Access &access, const Row *row, std::vector<uint8_t> &state) { FakeState(1, access, row, state); });
+  util::SeekOrThrow(binary.get(), 0);
+  {
+    Table table(util::DupOrThrow(binary.get()), util::READ);
+    BOOST_CHECK(table.Config().lm_state);
+    BOOST_CHECK_EQUAL(1234, table.Config().lm_checksum);
+    CheckFakeState(table, 1);
+  }
+
+  // State from another model replaces what was there.
+  util::SeekOrThrow(binary.get(), 0);
+  util::scoped_fd again(util::MakeTemp(util::DefaultTempDirectory()));
+  AddLMStates(binary.release(), util::DupOrThrow(again.get()), 5678, [](const Access &access, const Row *row, std::vector<uint8_t> &state) { FakeState(2, access, row, state); });
+  util::SeekOrThrow(again.get(), 0);
+  Table table(again.release(), util::READ);
+  BOOST_CHECK_EQUAL(5678, table.Config().lm_checksum);
+  CheckFakeState(table, 2);
+}
+
 } } // namespaces
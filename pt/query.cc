@@ -1,6 +1,8 @@
 #include "pt/query.hh"
 
+#include "pt/statistics.hh"
 #include "util/file.hh"
+#include "util/murmur_hash.hh"
 
 namespace pt {
 
@@ -10,16 +12,114 @@ FieldConfig LoadFieldConfig(FileFormat &format) {
   ret.Restore(format.Attach());
   return ret;
 }
+
+// Codebooks come between the config and the index.
+std::unique_ptr<CompactRows> LoadCompact(FileFormat &format, const FieldConfig &config) {
+  if (!config.compact) return std::unique_ptr<CompactRows>();
+  return std::unique_ptr<CompactRows>(new CompactRows(config, format.Attach()));
+}
 } // namespace
 
+Table::Shard::Shard(int fd, util::LoadMethod load_method)
+  : file(fd, kFileHeader, false, load_method),
+    rows(file.Attach()),
+    stats(file.Attach()),
+    config(LoadFieldConfig(file)),
+    compact(LoadCompact(file, config)),
+    offsets(file) {}
+
+uint64_t Table::Shard::Shards() const {
+  if (stats.size() < sizeof(Statistics)) return 1;
+  return reinterpret_cast<const Statistics*>(stats.get())->shards;
+}
+
+Table::Shards Table::OpenShard(int fd, util::LoadMethod load_method) {
+  Shards ret;
+  ret.emplace_back(new Shard(fd, load_method));
+  UTIL_THROW_IF2(ret.front()->Shards() != 1, "This phrase table has " << ret.front()->Shards() << " shards; open it by file name.");
+  return ret;
+}
+
+Table::Shards Table::OpenShards(const char *file, util::LoadMethod load_method) {
+  Shards ret;
+  ret.emplace_back(new Shard(util::OpenReadOrThrow(file), load_method));
+  const uint64_t count = ret.front()->Shards();
+  for (uint64_t i = 1; i < count; ++i) {
+    std::string name(ShardFile(file, i));
+    ret.emplace_back(new Shard(util::OpenReadOrThrow(name.c_str()), load_method));
+    UTIL_THROW_IF2(ret.back()->Shards() != count, "Phrase table shard " << name << " belongs to a table with " << ret.back()->Shards() << " shards, not " << count);
+  }
+  return ret;
+}
+
 Table::Table(int fd, util::LoadMethod load_method)
-  : file_(fd, kFileHeader, false, load_method),
-    rows_(file_.Attach()),
-    stats_(*reinterpret_cast<const Statistics*>(file_.Attach().get())),
-    access_(LoadFieldConfig(file_)),
-    offsets_(file_) {}
+  : shards_(OpenShard(fd, load_method)), access_(shards_.front()->config) {}
 
 Table::Table(const char *file, util::LoadMethod load_method)
-  : Table(util::OpenReadOrThrow(file), load_method) {}
+  : shards_(OpenShards(file, load_method)), access_(shards_.front()->config) {}
+
+Table::~Table() {}
+
+void Table::Lookup(const SourceSpan *spans, std::size_t count, SourceLookup *out) const {
+  // How many phrases each stage runs ahead of the next.  A power of 2.
+  const std::size_t kAhead = 8;
+  struct Pending {
+    uint64_t hash;
+    const Shard *shard;
+    const HashTableRegion<uint64_t>::Entry *ideal;
+    // Start of the bundle or nullptr if the phrase has no target phrases.
+    const char *base;
+    bool longer;
+  } pending[2 * kAhead];
+  const RowIterator end(nullptr, &access_, 0);
+  // Phrase i is hashed in step i, probed in step i + kAhead, and read in
+  // step i + 2 * kAhead.  Stages go last to first so a slot is read before
+  // it is reused.
+  for (std::size_t step = 0; step < count + 2 * kAhead; ++step) {
+    if (step >= 2 * kAhead) {
+      const std::size_t i = step - 2 * kAhead;
+      const Pending &p = pending[i % (2 * kAhead)];
+      out[i].rows = boost::iterator_range<RowIterator>(p.base ? Rows(*p.shard, p.base) : end, end);
+      out[i].longer = p.longer;
+    }
+    if (step >= kAhead && step - kAhead < count) {
+      Pending &p = pending[(step - kAhead) % (2 * kAhead)];
+      const uint64_t *found;
+      if (p.shard->offsets.FindFromIdeal(p.hash, p.ideal, found)) {
+        p.longer = *found & kIndexLonger;
+        if (*found & kIndexNoRows) {
+          p.base = nullptr;
+        } else {
+          p.base = p.shard->rows.begin() + (*found & kIndexOffset);
+          __builtin_prefetch(p.base, 0, 0);
+        }
+      } else {
+        p.base = nullptr;
+        p.longer = false;
+      }
+    }
+    if (step < count) {
+      Pending &p = pending[step % (2 * kAhead)];
+      p.hash = spans[step].hash;
+      p.shard = shards_[ShardOf(p.hash, shards_.size())].get();
+      p.ideal = p.shard->offsets.Ideal(p.hash);
+      __builtin_prefetch(p.ideal, 0, 0);
+    }
+  }
+}
+
+const Statistics &Table::Stats() const {
+  return *reinterpret_cast<const Statistics*>(shards_.front()->stats.get());
+}
+
+uint64_t Table::Fingerprint() const {
+  const Statistics &stats = Stats();
+  uint64_t ret = util::MurmurHash64A(&stats, sizeof(Statistics), 0);
+  for (const std::unique_ptr<Shard> &shard : shards_) {
+    uint64_t rows = shard->rows.size();
+    ret = util::MurmurHash64A(&rows, sizeof(rows), ret);
+  }
+  return ret;
+}
 
 } // namespace pt
@@ -1,16 +1,19 @@
 #pragma once
 
 #include "pt/access.hh"
+#include "pt/compact.hh"
 #include "pt/format.hh"
 #include "pt/hash.hh"
 #include "pt/hash_table_region.hh"
 
 #include <cassert>
 #include <iterator>
+#include <memory>
+#include <vector>
 
 namespace pt {
 
-class Statistics;
+struct Statistics;
 
 /*class CurriedRow {
   public:
@@ -30,12 +33,13 @@ class Statistics;
 
 class RowIterator : public std::iterator<std::forward_iterator_tag, const Row> {
   public:
-    RowIterator() {}
+    RowIterator() : row_(nullptr), access_(nullptr), remaining_(0), compact_(nullptr) {}
 
-    RowIterator(const Row *row, const Access *access, RowCount remaining) : row_(row), access_(access), remaining_(remaining) {}
+    RowIterator(const Row *row, const Access *access, RowCount remaining, CompactRows *compact = nullptr)
+      : row_(row), access_(access), remaining_(remaining), compact_(compact) {}
 
     RowIterator &operator++() {
-      row_ = access_->End(row_);
+      row_ = compact_ ? compact_->End(row_) : access_->End(row_);
       --remaining_;
       return *this;
     }
@@ -57,6 +61,12 @@ class RowIterator : public std::iterator<std::forward_iterator_tag, const Row> {
 
     const Access &Accessor() const { return *access_; }
 
+    // The row in the layout of Accessor().  Rows of compact tables are decoded
+    // into pool; others are returned as is.  Dereference only raw rows.
+    const Row *Decode(util::Pool &pool) const {
+      return compact_ ? compact_->Decode(row_, pool) : row_;
+    }
+
     // Remaining goes down.
     std::ptrdiff_t operator-(const RowIterator &other) const {
       return other.remaining_ - remaining_;
@@ -66,40 +76,109 @@ class RowIterator : public std::iterator<std::forward_iterator_tag, const Row> {
     const Row *row_;
     const Access *access_;
     RowCount remaining_;
+    CompactRows *compact_;
+};
+
+// A source phrase for Table::Lookup in batches.
+struct SourceSpan {
+  SourceSpan(const WordIndex *begin_in, const WordIndex *end_in)
+    : begin(begin_in), end(end_in), hash(HashSource(begin_in, end_in)) {}
+
+  // For callers that extended the hash of a prefix with HashExtend.
+  SourceSpan(const WordIndex *begin_in, const WordIndex *end_in, uint64_t hash_in)
+    : begin(begin_in), end(end_in), hash(hash_in) {}
+
+  const WordIndex *begin, *end;
+  // HashSource(begin, end).
+  uint64_t hash;
+};
+
+// What Table::Lookup found for a SourceSpan.
+struct SourceLookup {
+  boost::iterator_range<RowIterator> rows;
+  // Whether a longer source phrase in the table starts with this one.  If
+  // not, there is no point looking up extensions of the span.
+  bool longer;
 };
 
 class Table {
   public:
-    // Takes ownership of fd.
+    // Takes ownership of fd.  Sharded tables have to be opened by name.
     Table(int fd, util::LoadMethod load_method);
 
+    // If the table is sharded, the other shards are found with ShardFile.
     Table(const char *file, util::LoadMethod load_method);
 
+    ~Table();
+
     boost::iterator_range<RowIterator> Lookup(const WordIndex *source_begin, const WordIndex *source_end) const {
-      return boost::iterator_range<RowIterator>(Begin(source_begin, source_end), RowIterator(nullptr, &access_, 0));
+      return Lookup(SourceSpan(source_begin, source_end));
+    }
+
+    boost::iterator_range<RowIterator> Lookup(const SourceSpan &span) const {
+      return boost::iterator_range<RowIterator>(Begin(span.hash), RowIterator(nullptr, &access_, 0));
     }
 
+    /* Look up many source phrases at once, setting out[i].rows to what
+     * Lookup returns for spans[i].  Lookups are pipelined: buckets are
+     * prefetched a few phrases ahead of probing and row headers a few phrases
+     * ahead of reading, so their cache misses overlap instead of following
+     * one another.
+     */
+    void Lookup(const SourceSpan *spans, std::size_t count, SourceLookup *out) const;
+
     const Access &Accessor() { return access_; }
 
-    const Statistics &Stats() const { return stats_; }
+    const FieldConfig &Config() const { return shards_.front()->config; }
+
+    const Statistics &Stats() const;
+
+    // Changes when the table is binarized differently, so files derived from
+    // the table can tell whether they are stale.
+    uint64_t Fingerprint() const;
 
-    VocabRange Vocab() { return file_.Vocab(); }
+    VocabRange Vocab() { return shards_.front()->file.Vocab(); }
 
   private:
-    RowIterator Begin(const WordIndex *source_begin, const WordIndex *source_end) const {
+    RowIterator Begin(uint64_t hash) const {
+      const Shard &shard = *shards_[ShardOf(hash, shards_.size())];
       const uint64_t *found;
-      if (!offsets_.Find(HashSource(source_begin, source_end), found))
+      if (!shard.offsets.Find(hash, found) || (*found & kIndexNoRows))
         return RowIterator(nullptr, &access_, 0);
-      const char *base = rows_.begin() + *found;
+      return Rows(shard, shard.rows.begin() + (*found & kIndexOffset));
+    }
+
+    struct Shard;
+
+    // Rows of the bundle at base in shard.
+    RowIterator Rows(const Shard &shard, const char *base) const {
       RowCount count = *reinterpret_cast<const RowCount*>(base);
-      return RowIterator(reinterpret_cast<const Row*>(base + sizeof(RowCount)), &access_, count);
+      return RowIterator(reinterpret_cast<const Row*>(base + sizeof(RowCount)), &access_, count, shard.compact.get());
     }
 
-    FileFormat file_;
-    util::scoped_memory &rows_;
-    const Statistics &stats_;
+    // One file of the table.
+    struct Shard {
+      Shard(int fd, util::LoadMethod load_method);
+
+      // Number of shards this belongs to.
+      uint64_t Shards() const;
+
+      FileFormat file;
+      util::scoped_memory &rows;
+      util::scoped_memory &stats;
+      FieldConfig config;
+      // Set if config.compact.
+      std::unique_ptr<CompactRows> compact;
+      HashTableRegion<uint64_t> offsets;
+    };
+
+    typedef std::vector<std::unique_ptr<Shard> > Shards;
+
+    static Shards OpenShard(int fd, util::LoadMethod load_method);
+    static Shards OpenShards(const char *file, util::LoadMethod load_method);
+
+    Shards shards_;
     Access access_;
-    HashTableRegion<uint64_t> offsets_;
 };
 
 } // namespace pt
@@ -0,0 +1,65 @@
+#include "pt/rewrite.hh"
+
+#include "pt/hash.hh"
+#include "pt/hash_table_region.hh"
+#include "pt/word_array.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+
+#include <algorithm>
+#include <cstring>
+
+namespace pt {
+
+void BundleWriter::StartBundle(uint64_t offset, RowCount count) {
+  Flush();
+  old_offsets_.push_back(offset);
+  new_offsets_.push_back(out_.DirectWriteSize());
+  buffer_.resize(sizeof(RowCount));
+  std::memcpy(&buffer_[0], &count, sizeof(RowCount));
+}
+
+void BundleWriter::Flush() {
+  if (!buffer_.empty()) out_.DirectWriteTargetPhrases(&buffer_[0], buffer_.size());
+  buffer_.clear();
+}
+
+uint64_t BundleWriter::Remap(uint64_t old_offset) const {
+  std::vector<uint64_t>::const_iterator i = std::lower_bound(old_offsets_.begin(), old_offsets_.end(), old_offset);
+  UTIL_THROW_IF2(i == old_offsets_.end() || *i != old_offset, "Offset " << old_offset << " is not the start of a bundle.");
+  return new_offsets_[i - old_offsets_.begin()];
+}
+
+void RemappedOffsets::WriteTo(int fd, uint64_t) {
+  typedef HashTableRegion<uint64_t>::Entry Entry;
+  std::vector<Entry> buffer;
+  const Entry *end = reinterpret_cast<const Entry*>(from_.end());
+  for (const Entry *i = reinterpret_cast<const Entry*>(from_.begin()); i != end; ++i) {
+    buffer.push_back(*i);
+    if (i->key && !(i->value & kIndexNoRows)) {
+      buffer.back().value = (i->value & ~kIndexOffset) | writer_.Remap(i->value & kIndexOffset);
+    }
+    if (buffer.size() == 4096) {
+      util::WriteOrThrow(fd, buffer.data(), buffer.size() * sizeof(Entry));
+      buffer.clear();
+    }
+  }
+  util::WriteOrThrow(fd, buffer.data(), buffer.size() * sizeof(Entry));
+}
+
+void CopyRegion(const util::scoped_memory &from, util::scoped_memory &to) {
+  util::HugeRealloc(from.size(), false, to);
+  std::memcpy(to.get(), from.get(), from.size());
+}
+
+void CopyVocab(FileFormat &in, FileFormat &out) {
+  // The vocabulary is read like CreateTable wrote it.
+  WordArray words(out);
+  VocabRange vocab(in.Vocab());
+  for (VocabRange::Iterator word(vocab.begin()); word; ++word) {
+    words(*word);
+  }
+  words.Finish();
+}
+
+} // namespace pt
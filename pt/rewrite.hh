@@ -0,0 +1,76 @@
+#pragma once
+
+#include "pt/access.hh"
+#include "pt/format.hh"
+#include "pt/types.hh"
+#include "util/mmap.hh"
+
+#include <cstddef>
+#include <vector>
+
+/* Pieces shared by passes that rewrite the rows of a binary table, like
+ * CompactTable.  Rows are read a bundle at a time, the rows of one source
+ * phrase, and the index is rewritten to point at where each bundle moved.
+ */
+namespace pt {
+
+// Bundles are a RowCount then rows, back to back.  Calls
+// callback.StartBundle(offset, count) then callback.AddRow(row) for each row.
+template <class Callback> void ForEachBundle(const util::scoped_memory &rows, const Access &access, Callback &callback) {
+  for (const char *bundle = rows.begin(); bundle != rows.end(); ) {
+    RowCount count = *reinterpret_cast<const RowCount*>(bundle);
+    const Row *row = reinterpret_cast<const Row*>(bundle + sizeof(RowCount));
+    callback.StartBundle(bundle - rows.begin(), count);
+    for (RowCount i = 0; i < count; ++i, row = access.End(row)) {
+      callback.AddRow(row);
+    }
+    bundle = reinterpret_cast<const char*>(row);
+  }
+}
+
+// Writes rewritten bundles to a table's rows and remembers where each moved.
+class BundleWriter {
+  public:
+    explicit BundleWriter(FileFormat &out) : out_(out) {}
+
+    // Write the previous bundle and start one that was at offset.
+    void StartBundle(uint64_t offset, RowCount count);
+
+    // Call after the last row.
+    void Flush();
+
+    // Where the bundle that was at old_offset is now.
+    uint64_t Remap(uint64_t old_offset) const;
+
+  protected:
+    // The current bundle.  Append rows here.
+    std::vector<uint8_t> buffer_;
+
+  private:
+    FileFormat &out_;
+
+    // Where each bundle started in the old and new tables.  Both ascend.
+    std::vector<uint64_t> old_offsets_, new_offsets_;
+};
+
+// The old index with offsets moved by BundleWriter.  Buckets stay put.
+class RemappedOffsets : public StreamedRegion {
+  public:
+    RemappedOffsets(const util::scoped_memory &from, const BundleWriter &writer)
+      : from_(from), writer_(writer) {}
+
+    uint64_t Size() const { return from_.size(); }
+
+    void WriteTo(int fd, uint64_t);
+
+  private:
+    const util::scoped_memory &from_;
+    const BundleWriter &writer_;
+};
+
+void CopyRegion(const util::scoped_memory &from, util::scoped_memory &to);
+
+// Copy the vocabulary of in, which is not mapped, to out.
+void CopyVocab(FileFormat &in, FileFormat &out);
+
+} // namespace pt
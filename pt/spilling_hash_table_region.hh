@@ -0,0 +1,198 @@
+#pragma once
+
+#include "pt/format.hh"
+#include "pt/hash_table_region.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+#include "util/stream/chain.hh"
+#include "util/stream/io.hh"
+#include "util/stream/sort.hh"
+#include "util/stream/stream.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace pt {
+
+/* Builds the same region as HashTableRegion without holding the table in
+ * memory.  Entries are spilled to a temporary file.  The number of buckets is
+ * only known once all entries are in, so that is when they are sorted by ideal
+ * bucket.  Linear probing then places them in order so the table is written
+ * sequentially.  The few entries that would run off the end wrap around to
+ * the front of the table and are fixed up in place once everything else has
+ * been placed.  That needs to read the table back, and the output may be
+ * write-only like a redirected stdout, so the table is laid out in a
+ * temporary file and then copied to the output.  Entries with the same key
+ * are merged with combine, but still count towards the size of the table.
+ */
+template <class Value, class Combine> class SpillingHashTableRegion : public StreamedRegion {
+  private:
+    typedef HashTableRegion<Value> Region;
+    typedef typename Region::Entry Entry;
+    typedef typename Region::Table Table;
+
+  public:
+    // memory bounds the sort buffers.  Temporary files go to temp_prefix.
+    SpillingHashTableRegion(FileFormat &format, std::size_t memory, const std::string &temp_prefix, const Combine &combine = Combine())
+      : combine_(combine),
+        chain_(util::stream::ChainConfig(sizeof(Entry), 2, CheckMemory(memory) / 4)),
+        sort_config_(MakeSortConfig(memory, temp_prefix)),
+        spill_(util::MakeTemp(temp_prefix)),
+        put_(chain_.Add()) {
+      chain_ >> util::stream::WriteAndRecycle(spill_.get());
+      format.AttachStreamed(*this);
+    }
+
+    void Insert(uint64_t hash, const Value &value) {
+      Entry &entry = *static_cast<Entry*>(put_.Get());
+      entry.key = hash;
+      entry.value = value;
+      ++put_;
+      ++entries_;
+    }
+
+    // Call after the last Insert.
+    void Finish() {
+      put_.Poison();
+      chain_.Wait();
+    }
+
+    uint64_t Size() const {
+      return Table::Size(entries_, Region::kDefaultMultiply);
+    }
+
+    void WriteTo(int fd, uint64_t) {
+      const uint64_t buckets = Size() / sizeof(Entry);
+      const uint64_t mask = buckets - 1;
+      util::scoped_fd layout(util::MakeTemp(sort_config_.temp_prefix));
+      std::vector<Entry> buffer;
+      buffer.reserve(kWriteBuffer);
+      // Entries that ran past the last bucket.
+      std::vector<Entry> wrapped;
+      uint64_t next = 0;
+
+      chain_ >> util::stream::PRead(spill_.get());
+      util::stream::BlockingSort(chain_, sort_config_, CompareBuckets(mask), util::stream::NeverCombine());
+      spill_.reset();
+      util::stream::Stream sorted;
+      chain_ >> sorted >> util::stream::kRecycle;
+      // Place an entry with a distinct key.
+      auto place = [&](const Entry &entry) {
+        if (next == buckets) {
+          wrapped.push_back(entry);
+          return;
+        }
+        for (uint64_t ideal = entry.key & mask; next < ideal; ++next) {
+          Append(layout.get(), Empty(), buffer);
+        }
+        Append(layout.get(), entry, buffer);
+        ++next;
+      };
+      // Entries with the same key are adjacent.
+      Entry current;
+      bool have = false;
+      for (; sorted; ++sorted) {
+        const Entry &entry = *static_cast<const Entry*>(sorted.Get());
+        if (have && entry.key == current.key) {
+          current.value = combine_(current.value, entry.value);
+          continue;
+        }
+        if (have) place(current);
+        current = entry;
+        have = true;
+      }
+      if (have) place(current);
+      chain_.Wait();
+      for (; next < buckets; ++next) {
+        Append(layout.get(), Empty(), buffer);
+      }
+      util::WriteOrThrow(layout.get(), buffer.data(), buffer.size() * sizeof(Entry));
+
+      // Everything from the ideal bucket of a wrapped entry to the end is
+      // full, so probing continues at the front of the table.
+      uint64_t bucket = 0;
+      for (const Entry &entry : wrapped) {
+        for (; ; ++bucket) {
+          UTIL_THROW_IF2(bucket == buckets, "Hash table has no free buckets.");
+          Entry existing;
+          util::ErsatzPRead(layout.get(), &existing, sizeof(Entry), bucket * sizeof(Entry));
+          if (!existing.key) {
+            util::ErsatzPWrite(layout.get(), &entry, sizeof(Entry), bucket * sizeof(Entry));
+            break;
+          }
+        }
+      }
+
+      util::SeekOrThrow(layout.get(), 0);
+      buffer.resize(kWriteBuffer);
+      for (uint64_t copied = 0; copied < buckets; copied += buffer.size()) {
+        std::size_t count = std::min<uint64_t>(buffer.size(), buckets - copied);
+        util::ReadOrThrow(layout.get(), buffer.data(), count * sizeof(Entry));
+        util::WriteOrThrow(fd, buffer.data(), count * sizeof(Entry));
+      }
+    }
+
+  private:
+    static const std::size_t kWriteBuffer = 4096;
+
+    // By ideal bucket, then by key so equal keys are adjacent.
+    class CompareBuckets {
+      public:
+        explicit CompareBuckets(uint64_t mask) : mask_(mask) {}
+
+        bool operator()(const void *first, const void *second) const {
+          // SizedSort also instantiates this for sizes smaller than Entry,
+          // so copy the key out instead of dereferencing an Entry pointer.
+          uint64_t first_key, second_key;
+          std::memcpy(&first_key, first, sizeof(uint64_t));
+          std::memcpy(&second_key, second, sizeof(uint64_t));
+          if ((first_key & mask_) != (second_key & mask_)) return (first_key & mask_) < (second_key & mask_);
+          return first_key < second_key;
+        }
+
+      private:
+        uint64_t mask_;
+    };
+
+    static std::size_t CheckMemory(std::size_t memory) {
+      UTIL_THROW_IF2(memory < 64 * sizeof(Entry), "Hash table memory " << memory << " is too small.");
+      return memory;
+    }
+
+    static util::stream::SortConfig MakeSortConfig(std::size_t memory, const std::string &temp_prefix) {
+      util::stream::SortConfig ret;
+      ret.temp_prefix = temp_prefix;
+      ret.buffer_size = std::min<std::size_t>(64 << 20, memory / 8);
+      ret.total_memory = memory / 2;
+      return ret;
+    }
+
+    static Entry Empty() {
+      Entry ret;
+      ret.key = 0;
+      ret.value = Value();
+      return ret;
+    }
+
+    static void Append(int fd, const Entry &entry, std::vector<Entry> &buffer) {
+      buffer.push_back(entry);
+      if (buffer.size() == kWriteBuffer) {
+        util::WriteOrThrow(fd, buffer.data(), buffer.size() * sizeof(Entry));
+        buffer.clear();
+      }
+    }
+
+    Combine combine_;
+
+    util::stream::Chain chain_;
+    util::stream::SortConfig sort_config_;
+    util::scoped_fd spill_;
+    util::stream::Stream put_;
+
+    uint64_t entries_ = 0;
+};
+
+} // namespace pt
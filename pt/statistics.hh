@@ -1,11 +1,16 @@
 #pragma once
 
+#include <stdint.h>
+
 namespace pt {
 
 struct Statistics {
   uint64_t max_source_phrase_length;
   // Total size of the vocabulary (source and target words share the same space of ids)
   uint64_t vocab_size;
+  // Number of files the table is split into, see ShardOf in hash.hh.  Tables
+  // written before sharding have a shorter region without this field.
+  uint64_t shards;
 };
 
 } // namespace pt
@@ -48,6 +48,7 @@ template <class Model> PartialEdge EdgeGenerator::Pop(const Context<Model> &cont
   assert(!generate_.empty());
   PartialEdge top = generate_.top();
   generate_.pop();
+  SEARCH_STATS_INC(popped_);
   PartialVertex *const top_nt = top.NT();
   const Arity arity = top.GetArity();
 
@@ -89,6 +90,7 @@ template <class Model> PartialEdge EdgeGenerator::Pop(const Context<Model> &cont
     memcpy(alternate.Between(), top.Between(), sizeof(lm::ngram::ChartState) * (incomplete + 1));
 
     // TODO: dedupe?  
+    SEARCH_STATS_INC(pushed_);
     generate_.push(alternate);
   }
 
@@ -98,6 +100,7 @@ template <class Model> PartialEdge EdgeGenerator::Pop(const Context<Model> &cont
   // top is now the continuation.
   FastScore(context, victim, victim - victim_completed, incomplete, old_value, top);
   // TODO: dedupe?  
+  SEARCH_STATS_INC(pushed_);
   generate_.push(top);
   assert(lowest_niceness != 254 || top.GetScore() == before);
 
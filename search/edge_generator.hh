@@ -6,6 +6,15 @@
 
 #include <queue>
 
+#include <stdint.h>
+
+// Counting pushes and pops for profiling is compiled in with -DSEARCH_STATS.
+#ifdef SEARCH_STATS
+#define SEARCH_STATS_INC(counter) (++(counter))
+#else
+#define SEARCH_STATS_INC(counter)
+#endif
+
 namespace lm {
 namespace ngram {
 class ChartState;
@@ -30,14 +39,31 @@ class EdgeGenerator {
         assert(!i->Empty());
       }
 #endif
+      SEARCH_STATS_INC(pushed_);
       generate_.push(edge);
     }
 
     bool Empty() const { return generate_.empty(); }
 
+    // Drop any remaining edges so the generator can be used for another
+    // search.  Memory is kept.
+    void Clear() {
+      generate_.Clear();
+      partial_edge_pool_.Reset();
+#ifdef SEARCH_STATS
+      pushed_ = 0;
+      popped_ = 0;
+#endif
+    }
+
     // Pop.  If there's a complete hypothesis, return it.  Otherwise return an invalid PartialEdge.
     template <class Model> PartialEdge Pop(const Context<Model> &context);
 
+#ifdef SEARCH_STATS
+    uint64_t Pushed() const { return pushed_; }
+    uint64_t Popped() const { return popped_; }
+#endif
+
     template <class Model, class Output> void Search(const Context<Model> &context, Output &output) {
       unsigned to_pop = context.PopLimit();
       while (to_pop > 0 && !generate_.empty()) {
@@ -54,8 +80,16 @@ class EdgeGenerator {
   private:
     util::Pool partial_edge_pool_;
 
-    typedef std::priority_queue<PartialEdge> Generate;
+    // A priority queue that can be emptied without losing its capacity.
+    class Generate : public std::priority_queue<PartialEdge> {
+      public:
+        void Clear() { c.clear(); }
+    };
     Generate generate_;
+
+#ifdef SEARCH_STATS
+    uint64_t pushed_ = 0, popped_ = 0;
+#endif
 };
 
 } // namespace search
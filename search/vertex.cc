@@ -186,4 +186,19 @@ void VertexNode::BuildExtend() {
   }
 }
 
+void VertexNode::BuildExtendAll() {
+  BuildExtend();
+  for (std::vector<VertexNode>::iterator i = extend_.begin(); i != extend_.end(); ++i) {
+    i->BuildExtendAll();
+  }
+}
+
+std::size_t VertexNode::MemoryUsage() const {
+  std::size_t ret = hypos_.capacity() * sizeof(HypoState) + extend_.capacity() * sizeof(VertexNode);
+  for (std::vector<VertexNode>::const_iterator i = extend_.begin(); i != extend_.end(); ++i) {
+    ret += i->MemoryUsage();
+  }
+  return ret;
+}
+
 } // namespace search
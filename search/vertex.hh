@@ -34,7 +34,7 @@ class VertexNode {
   public:
     VertexNode() {}
 
-    void InitRoot() { hypos_.clear(); }
+    void InitRoot() { hypos_.clear(); extend_.clear(); }
 
     /* The steps of building a VertexNode:
      * 1. Default construct.
@@ -63,6 +63,13 @@ class VertexNode {
 
     void BuildExtend();
 
+    // BuildExtend recursively.  Afterwards search only reads this node, so it
+    // can be shared between threads.
+    void BuildExtendAll();
+
+    // Approximate heap memory used by this node and everything below it.
+    std::size_t MemoryUsage() const;
+
     // Should only happen to a root node when the entire vertex is empty.   
     bool Empty() const {
       return hypos_.empty() && extend_.empty();
@@ -7,8 +7,9 @@
 namespace util {
 
 template <> struct ToStringBuf<double> {
-  // DoubleToStringConverter::kBase10MaximalLength + 1 for null paranoia.
-  static const unsigned kBytes = 19;
+  // Up to 17 significant digits, which may follow "-0.00000" because the
+  // converter only switches to exponents below 1e-6, + 1 for null paranoia.
+  static const unsigned kBytes = 26;
 };
 
 // Single wasn't documented in double conversion, so be conservative and
@@ -32,4 +32,10 @@ uint32_t MutableVocab::FindOrInsert(const StringPiece &str) {
   return it->id;
 }
 
+void MutableVocab::Clear() {
+  map_.Clear();
+  strings_.resize(1);
+  piece_backing_.Reset();
+}
+
 } // namespace util
@@ -51,6 +51,9 @@ class MutableVocab {
 
     // Includes kUNK.
     std::size_t Size() const { return strings_.size(); }
+
+    // Remove every word except kUNK, keeping the memory.
+    void Clear();
     
   private:
     util::Pool piece_backing_;
@@ -107,8 +110,18 @@ template <class NewWordAction = NoOpUniqueWords> class GrowableVocab {
       return lookup_.Find(HashForVocab(str), i) ? i->value : 0;
     }
 
+    // Key FindOrInsert uses, so callers can hash words on other threads.
+    static uint64_t Hash(const StringPiece &word) {
+      return util::MurmurHashNative(word.data(), word.size());
+    }
+
     WordIndex FindOrInsert(const StringPiece &word) {
-      ProbingVocabularyEntry entry = ProbingVocabularyEntry::Make(util::MurmurHashNative(word.data(), word.size()), Size());
+      return FindOrInsert(word, Hash(word));
+    }
+
+    // hash must be Hash(word).
+    WordIndex FindOrInsert(const StringPiece &word, uint64_t hash) {
+      ProbingVocabularyEntry entry = ProbingVocabularyEntry::Make(hash, Size());
       Lookup::MutableIterator it;
       if (!lookup_.FindOrInsert(entry, it)) {
         new_word_(word);
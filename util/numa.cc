@@ -0,0 +1,43 @@
+#include "util/numa.hh"
+
+#include "util/exception.hh"
+
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
+namespace util {
+
+#ifdef HAVE_NUMA
+
+std::size_t NumaNodes() {
+  if (numa_available() < 0) return 1;
+  return numa_max_node() + 1;
+}
+
+void BindToNumaNode(std::size_t node) {
+  UTIL_THROW_IF(node >= NumaNodes(), Exception, "NUMA node " << node << " does not exist; there are " << NumaNodes());
+  if (numa_available() < 0) return;
+  UTIL_THROW_IF(numa_run_on_node(node), ErrnoException, "Failed to run on NUMA node " << node);
+  numa_set_preferred(node);
+}
+
+void UnbindNuma() {
+  if (numa_available() < 0) return;
+  UTIL_THROW_IF(numa_run_on_node(-1), ErrnoException, "Failed to run on all NUMA nodes");
+  numa_set_localalloc();
+}
+
+#else // HAVE_NUMA
+
+std::size_t NumaNodes() { return 1; }
+
+void BindToNumaNode(std::size_t node) {
+  UTIL_THROW_IF(node, Exception, "NUMA node " << node << " requested, but this build has no NUMA support");
+}
+
+void UnbindNuma() {}
+
+#endif // HAVE_NUMA
+
+} // namespace util
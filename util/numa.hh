@@ -0,0 +1,26 @@
+#ifndef UTIL_NUMA_H
+#define UTIL_NUMA_H
+
+/* Optional NUMA placement, using libnuma when the build found it.  Without
+ * it, or on a machine without NUMA, there is one node and binding does
+ * nothing.
+ */
+
+#include <cstddef>
+
+namespace util {
+
+// Number of NUMA nodes.  At least 1.
+std::size_t NumaNodes();
+
+// Run the calling thread on node's CPUs and prefer node's memory for its
+// allocations.  Pages are placed when first touched, so memory malloc'ed and
+// read by this thread lands on node.
+void BindToNumaNode(std::size_t node);
+
+// Undo BindToNumaNode for the calling thread.
+void UnbindNuma();
+
+} // namespace util
+
+#endif // UTIL_NUMA_H
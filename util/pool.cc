@@ -8,7 +8,7 @@
 
 namespace util {
 
-Pool::Pool() {
+Pool::Pool() : capacity_(0) {
   current_ = NULL;
   current_end_ = NULL;
 }
@@ -22,14 +22,28 @@ void Pool::FreeAll() {
     free(*i);
   }
   free_list_.clear();
+  capacity_ = 0;
   current_ = NULL;
   current_end_ = NULL;
 }
 
+void Pool::Reset() {
+  if (free_list_.empty()) return;
+  if (free_list_.size() > 1) {
+    std::size_t total = capacity_;
+    FreeAll();
+    More(total);
+  }
+  current_ = static_cast<uint8_t*>(free_list_.front());
+}
+
 void *Pool::More(std::size_t size) {
-  std::size_t amount = std::max(static_cast<size_t>(32) << free_list_.size(), size);
+  // Grow geometrically from the total, not the block count, which Reset
+  // brings back down to 1.
+  std::size_t amount = std::max(std::max(static_cast<size_t>(32) << free_list_.size(), capacity_), size);
   uint8_t *ret = static_cast<uint8_t*>(MallocOrThrow(amount));
   free_list_.push_back(ret);
+  capacity_ += amount;
   current_ = ret + size;
   current_end_ = ret + amount;
   return ret;